@@ -0,0 +1,903 @@
+#ifndef CCUT_CORE_H
+#define CCUT_CORE_H
+
+// The part of the framework a file of tests needs: registration and the basic
+// assertions. Including this instead of ccut_framework.h keeps test files
+// cheap to compile, since it pulls in no streams, strings or containers and
+// a passing assertion instantiates nothing but a comparison. Failure messages
+// are built out of line, by the one translation unit that defines
+// CCUT_IMPLEMENT before including ccut_framework.h, usually the one with
+// TEST_MAIN():
+//
+//     #define CCUT_IMPLEMENT
+//     #include "ccut_framework.h"
+//
+//     TEST_MAIN()
+//
+// Operands of failed comparisons are shown for numbers, characters, strings
+// and pointers; anything else is shown by its bytes. Fixtures, typed and
+// parameterized tests, and the timing and allocation checks need the full
+// header, as does showing values through operator<< or a formatter.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// Builds without exceptions record failed assertions in a per-thread slot and
+// return from the test instead of throwing. Detected from -fno-exceptions, or
+// forced with -DCCUT_NO_EXCEPTIONS.
+#if !defined(CCUT_NO_EXCEPTIONS)
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define CCUT_NO_EXCEPTIONS 0
+#else
+#define CCUT_NO_EXCEPTIONS 1
+#endif
+#endif
+
+#if !CCUT_NO_EXCEPTIONS
+#include <exception>
+#endif
+
+// Branch hints and attributes for keeping failure handling off the hot path
+#if defined(__GNUC__) || defined(__clang__)
+#define CCUT_LIKELY(x) __builtin_expect(!!(x), 1)
+#define CCUT_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define CCUT_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+#define CCUT_LIKELY(x) (x)
+#define CCUT_UNLIKELY(x) (x)
+#define CCUT_COLD __declspec(noinline)
+#else
+#define CCUT_LIKELY(x) (x)
+#define CCUT_UNLIKELY(x) (x)
+#define CCUT_COLD
+#endif
+
+// Checks that a variable is initialized at compile time where the compiler can
+#if defined(__cpp_constinit)
+#define CCUT_CONSTINIT constinit
+#else
+#define CCUT_CONSTINIT
+#endif
+
+namespace ccut_framework
+{
+
+// Test function type
+typedef void(*test_func_t)();
+
+// Starts an async test's coroutine for the given test, suspended before its
+// first statement. See TEST_ASYNC() in ccut_framework.h.
+struct async_test;
+typedef void(*async_start_t)(async_test& test);
+
+//              //
+// Registration //
+//              //
+
+// Intrusive list of registered nodes. Each registry is an inline variable, so
+// there is exactly one per process and every translation unit that includes
+// this header adds to the same list. Registries are constant initialized, so
+// they are ready before any test's static constructor runs in any translation
+// unit, and registering a test is a couple of stores with no guard or
+// allocation. Nothing is sorted until test_main() knows which tests it wants.
+template <typename Node>
+struct registry_list
+{
+    Node* head = nullptr;
+    size_t size = 0;
+
+    inline void push(Node* node)
+    {
+        node->next = head;
+        head = node;
+        size++;
+    }
+};
+
+class RegisterTest;
+class RegisterBenchmark;
+
+CCUT_CONSTINIT inline registry_list<RegisterTest> test_registry_list;
+CCUT_CONSTINIT inline registry_list<RegisterBenchmark> bench_registry_list;
+
+// All tests to be run in test_main()
+inline registry_list<RegisterTest>& test_registry()
+{
+    return test_registry_list;
+}
+
+// All benchmarks, run by test_main() when asked to
+inline registry_list<RegisterBenchmark>& bench_registry()
+{
+    return bench_registry_list;
+}
+
+// Register a new test
+class RegisterTest
+{
+public:
+    inline RegisterTest(const char* name, test_func_t func, bool serial = false, const char* const* tags = nullptr,
+                        async_start_t async = nullptr)
+        : name(name)
+        , func(func)
+        , serial(serial)
+        , tags(tags)
+        , async(async)
+    {
+        test_registry().push(this);
+    }
+
+    const char* name;
+    test_func_t func;        // For async tests, runs the coroutine to completion on the calling thread
+    bool serial;             // Must not run concurrently with other tests
+    const char* const* tags; // Null-terminated, or null for no tags
+    async_start_t async;     // Set for async tests, which the runner can interleave on one thread
+    RegisterTest* next = nullptr;
+};
+
+// Benchmark function type; the body is one operation to be timed
+typedef void(*bench_func_t)();
+
+// Register a new benchmark
+class RegisterBenchmark
+{
+public:
+    inline RegisterBenchmark(const char* name, bench_func_t func)
+        : name(name)
+        , func(func)
+    {
+        bench_registry().push(this);
+    }
+
+    const char* name;
+    bench_func_t func;
+    RegisterBenchmark* next = nullptr;
+};
+
+//                        //
+// Floating Point Kernels //
+//                        //
+
+// How far apart two floating point values were found to be
+enum class float_measure : unsigned char
+{
+    absolute, // |a - b|
+    relative, // |a - b| / max(|a|, |b|)
+    ulps,     // Representable values between a and b
+};
+
+static inline long double float_abs(long double value)
+{
+    return value < 0 ? -value : value;
+}
+
+// Whether a and b are within an absolute tolerance. Equal values pass even
+// when infinite; NaN never does.
+static inline bool near_absolute(long double a, long double b, long double tolerance, long double& difference)
+{
+    difference = float_abs(a - b);
+    return a == b || difference <= tolerance;
+}
+
+// Whether a and b are within a tolerance relative to the larger of them
+static inline bool near_relative(long double a, long double b, long double tolerance, long double& difference)
+{
+    long double scale = float_abs(a) > float_abs(b) ? float_abs(a) : float_abs(b);
+    difference = scale > 0 ? float_abs(a - b) / scale : 0;
+    return a == b || difference <= tolerance;
+}
+
+// Distance between two floats or doubles in units in the last place, or the
+// largest distance there is if either is NaN. +0 and -0 are 0 apart.
+template <typename T>
+static inline uint64_t ulp_distance(T a, T b)
+{
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "ULP comparisons need float or double operands");
+    typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type bits_type;
+
+    if (a != a || b != b)
+        return UINT64_MAX;
+    if (a == b)
+        return 0;
+
+    // Map sign and magnitude onto an unsigned scale where adjacent values are adjacent integers
+    auto biased = [](T value) {
+        const bits_type sign = bits_type(1) << (sizeof(T) * 8 - 1);
+        bits_type bits;
+        std::memcpy(&bits, &value, sizeof(T));
+        return (bits & sign) ? static_cast<bits_type>(~bits + 1) : static_cast<bits_type>(bits | sign);
+    };
+    bits_type ba = biased(a);
+    bits_type bb = biased(b);
+    return ba > bb ? ba - bb : bb - ba;
+}
+
+// Count the elements of two arrays further apart than a tolerance. The loop
+// has no early exit or data-dependent branch, so it compiles to vector
+// compares and masks. Equal elements pass even when infinite; NaN never does.
+template <typename T1, typename T2, typename T>
+static inline size_t count_far(const T1* a, const T2* b, size_t count, T tolerance)
+{
+    size_t far = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        T x = static_cast<T>(a[i]);
+        T y = static_cast<T>(b[i]);
+        bool near = (x - y <= tolerance) & (y - x <= tolerance);
+        far += !(near | (x == y));
+    }
+    return far;
+}
+
+// The first element counted by count_far()
+template <typename T1, typename T2, typename T>
+static inline size_t first_far(const T1* a, const T2* b, size_t count, T tolerance)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        T x = static_cast<T>(a[i]);
+        T y = static_cast<T>(b[i]);
+        if (!(x - y <= tolerance && y - x <= tolerance) && !(x == y))
+            return i;
+    }
+    return count;
+}
+
+// The floating point type two operands are compared as
+template <typename T1, typename T2>
+using float_type = typename std::conditional<std::is_floating_point<typename std::common_type<T1, T2>::type>::value,
+                                             typename std::common_type<T1, T2>::type, double>::type;
+
+//               //
+// Range Kernels //
+//               //
+
+// Blocks are searched for their first difference a stride of this many bytes
+// at a time, then a chunk of this many, so a late difference in a huge block
+// costs few memcmp() calls
+static constexpr size_t bytes_mismatch_stride = size_t(1) << 16;
+static constexpr size_t bytes_mismatch_chunk = 64;
+
+// Elements shown either side of the first difference between two ranges
+static constexpr size_t range_context = 2;
+
+// Find the byte memcmp() reported a difference at, chunk by chunk
+CCUT_COLD static inline size_t find_byte_difference(const unsigned char* lhs, const unsigned char* rhs, size_t size)
+{
+    size_t offset = 0;
+    while (size - offset > bytes_mismatch_stride && std::memcmp(lhs + offset, rhs + offset, bytes_mismatch_stride) == 0)
+    {
+        offset += bytes_mismatch_stride;
+    }
+    while (size - offset > bytes_mismatch_chunk && std::memcmp(lhs + offset, rhs + offset, bytes_mismatch_chunk) == 0)
+    {
+        offset += bytes_mismatch_chunk;
+    }
+    while (offset < size && lhs[offset] == rhs[offset])
+    {
+        offset++;
+    }
+    return offset;
+}
+
+// The offset of the first byte at which two blocks differ, or size if they're
+// the same. Equal blocks cost a single memcmp().
+static inline size_t bytes_mismatch(const void* lhs, const void* rhs, size_t size)
+{
+    if (CCUT_LIKELY(size == 0 || std::memcmp(lhs, rhs, size) == 0))
+        return size;
+    return find_byte_difference(static_cast<const unsigned char*>(lhs), static_cast<const unsigned char*>(rhs), size);
+}
+
+// Element types whose == is the same as comparing their bytes
+template <typename T1, typename T2>
+struct is_bytewise_equal
+    : std::integral_constant<bool, std::is_same<typename std::remove_cv<T1>::type, typename std::remove_cv<T2>::type>::value
+                                       && (std::is_integral<T1>::value || std::is_enum<T1>::value
+                                           || std::is_pointer<T1>::value)>
+{};
+
+// The index of the first of count elements at which two ranges differ, or
+// count if they don't. Pointers to integers, enums and pointers are compared
+// with memcmp(); anything else element by element.
+template <typename It1, typename It2>
+static inline size_t range_mismatch(It1 lhs, It2 rhs, size_t count)
+{
+    if constexpr (std::is_pointer<It1>::value && std::is_pointer<It2>::value
+                  && is_bytewise_equal<typename std::remove_pointer<It1>::type,
+                                       typename std::remove_pointer<It2>::type>::value)
+    {
+        return bytes_mismatch(lhs, rhs, count * sizeof(*lhs)) / sizeof(*lhs);
+    }
+    else
+    {
+        for (size_t index = 0; index < count; ++index, ++lhs, ++rhs)
+        {
+            if (!(*lhs == *rhs))
+                return index;
+        }
+        return count;
+    }
+}
+
+template <typename It, typename = void>
+struct is_random_access : std::false_type
+{};
+
+template <typename It>
+struct is_random_access<It, decltype(void(std::declval<It>() - std::declval<It>()),
+                                     void(std::declval<It>() + 1))> : std::true_type
+{};
+
+// The number of elements in [begin, end)
+template <typename It>
+static inline size_t range_size(It begin, It end)
+{
+    if constexpr (is_random_access<It>::value)
+    {
+        return static_cast<size_t>(end - begin);
+    }
+    else
+    {
+        size_t size = 0;
+        for (; begin != end; ++begin)
+        {
+            size++;
+        }
+        return size;
+    }
+}
+
+// Containers with contiguous storage, such as std::vector and std::array
+template <typename C, typename = void>
+struct is_contiguous : std::false_type
+{};
+
+template <typename C>
+struct is_contiguous<C, decltype(void(std::declval<const C&>().data() + std::declval<const C&>().size()))>
+    : std::is_pointer<decltype(std::declval<const C&>().data())>
+{};
+
+// Where a container's elements start: its storage when it's contiguous, or
+// else its begin() iterator
+template <typename C>
+static inline auto container_begin(const C& container)
+{
+    if constexpr (is_contiguous<C>::value)
+        return container.data();
+    else
+        return container.begin();
+}
+
+template <typename T, size_t N>
+static inline const T* container_begin(const T (&container)[N])
+{
+    return container;
+}
+
+template <typename C>
+static inline size_t container_size(const C& container)
+{
+    if constexpr (is_contiguous<C>::value)
+        return container.size();
+    else
+        return range_size(container.begin(), container.end());
+}
+
+template <typename T, size_t N>
+static inline size_t container_size(const T (&)[N])
+{
+    return N;
+}
+
+// Where two ranges first differ, and which of their elements a failure shows
+struct range_difference
+{
+    size_t index;     // The first differing element, or the shorter size if one is a prefix of the other
+    size_t lhs_size;
+    size_t rhs_size;
+    size_t first;     // The first element shown
+    size_t lhs_shown; // How many elements are shown from each side
+    size_t rhs_shown;
+};
+
+static inline range_difference locate_difference(size_t index, size_t lhs_size, size_t rhs_size)
+{
+    range_difference where = {index, lhs_size, rhs_size, 0, 0, 0};
+    where.first = index > range_context ? index - range_context : 0;
+    size_t last = index + range_context + 1;
+    where.lhs_shown = (lhs_size < last ? lhs_size : last) - where.first;
+    where.rhs_shown = (rhs_size < last ? rhs_size : last) - where.first;
+    return where;
+}
+
+//                 //
+// Lean Assertions //
+//                 //
+
+// The checks behind the assertion macros in files that only include this
+// header. They mirror the full header's, but hand failures to functions
+// compiled once, where CCUT_IMPLEMENT is defined.
+namespace lean
+{
+
+// An operand of a failed comparison, captured as plain data so it can be
+// formatted out of line
+struct value_ref
+{
+    enum kind_type : unsigned char
+    {
+        bytes,        // Any other type; data points at size bytes
+        boolean,
+        character,    // char, shown as a character and its code
+        narrow,       // signed or unsigned char, shown as a character
+        signed_int,
+        unsigned_int,
+        floating,     // size is the sizeof the original type
+        c_string,     // data and size, or a null data pointer
+        string,       // A std::string or similar, by data and size
+        pointer,
+        null_pointer, // std::nullptr_t
+    };
+
+    kind_type kind;
+    size_t size;
+    const void* data;
+    long long signed_value;
+    unsigned long long unsigned_value;
+    long double floating_value;
+};
+
+// String classes such as std::string and std::string_view
+template <typename T, typename = void>
+struct is_char_string : std::false_type
+{};
+
+template <typename T>
+struct is_char_string<T, decltype(void(T::npos), void(static_cast<const char*>(std::declval<const T&>().data())),
+                                  void(std::declval<const T&>().size()))> : std::true_type
+{};
+
+template <typename T>
+static inline value_ref capture(const T& value)
+{
+    value_ref ref = {value_ref::bytes, sizeof(T), &value, 0, 0, 0};
+    if constexpr (std::is_same<T, bool>::value)
+    {
+        ref.kind = value_ref::boolean;
+        ref.unsigned_value = value;
+    }
+    else if constexpr (std::is_same<T, char>::value)
+    {
+        ref.kind = value_ref::character;
+        ref.signed_value = value;
+    }
+    else if constexpr (std::is_same<T, signed char>::value || std::is_same<T, unsigned char>::value)
+    {
+        ref.kind = value_ref::narrow;
+        ref.signed_value = static_cast<char>(value);
+    }
+    else if constexpr (std::is_integral<T>::value || (std::is_enum<T>::value && std::is_convertible<T, long long>::value))
+    {
+        // Scoped enums aren't numbers to their users, so they keep their bytes
+        using number = typename std::conditional<std::is_enum<T>::value, std::underlying_type<T>,
+                                                 std::common_type<T>>::type::type;
+        if (std::is_signed<number>::value)
+        {
+            ref.kind = value_ref::signed_int;
+            ref.signed_value = static_cast<long long>(value);
+        }
+        else
+        {
+            ref.kind = value_ref::unsigned_int;
+            ref.unsigned_value = static_cast<unsigned long long>(value);
+        }
+    }
+    else if constexpr (std::is_floating_point<T>::value)
+    {
+        ref.kind = value_ref::floating;
+        ref.floating_value = value;
+    }
+    else if constexpr (std::is_same<T, std::nullptr_t>::value)
+    {
+        ref.kind = value_ref::null_pointer;
+    }
+    else if constexpr (std::is_same<typename std::decay<T>::type, char*>::value
+                       || std::is_same<typename std::decay<T>::type, const char*>::value)
+    {
+        const char* str = value;
+        ref.kind = value_ref::c_string;
+        ref.data = str;
+        ref.size = 0;
+        if (str)
+        {
+            // An array's string ends at its first NUL or its end
+            size_t limit = std::is_array<T>::value ? sizeof(T) : static_cast<size_t>(-1);
+            while (ref.size < limit && str[ref.size])
+            {
+                ref.size++;
+            }
+        }
+    }
+    else if constexpr (std::is_pointer<T>::value && !std::is_function<typename std::remove_pointer<T>::type>::value)
+    {
+        ref.kind = value_ref::pointer;
+        ref.data = value;
+    }
+    else if constexpr (is_char_string<T>::value)
+    {
+        ref.kind = value_ref::string;
+        ref.data = value.data();
+        ref.size = value.size();
+    }
+    return ref;
+}
+
+CCUT_COLD void fail_boolean(bool expected, const char* str, int line, bool fatal);
+CCUT_COLD void fail_values(const char* kind, const value_ref& lhs, const value_ref& rhs, const char* lhs_str,
+                           const char* rhs_str, int line, bool fatal);
+CCUT_COLD void fail_exception(bool expected, const char* str, int line, bool fatal);
+CCUT_COLD void fail_near(float_measure measure, long double lhs, long double rhs, size_t float_size,
+                         long double found, const char* lhs_str, const char* rhs_str,
+                         const char* limit_str, int line, bool fatal);
+CCUT_COLD void fail_array_near(long double lhs, long double rhs, size_t float_size, size_t index, size_t far,
+                               size_t count, const char* lhs_str, const char* rhs_str,
+                               const char* limit_str, int line, bool fatal);
+CCUT_COLD void fail_bytes(const void* lhs, const void* rhs, size_t size, size_t offset, const char* lhs_str,
+                          const char* rhs_str, int line, bool fatal);
+CCUT_COLD void fail_range(const char* kind, const range_difference& where, const value_ref* lhs,
+                          const value_ref* rhs, const char* lhs_str, const char* rhs_str, int line, bool fatal);
+
+static inline bool assert_true(bool expr, const char* str, int line, bool fatal = true)
+{
+    if (CCUT_UNLIKELY(!expr))
+    {
+        fail_boolean(true, str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+static inline bool assert_false(bool expr, const char* str, int line, bool fatal = true)
+{
+    if (CCUT_UNLIKELY(expr))
+    {
+        fail_boolean(false, str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_equal(const T1& lhs, const T2& rhs, const char* lhs_str, const char* rhs_str, int line,
+                                bool fatal = true)
+{
+    if (CCUT_UNLIKELY(!(lhs == rhs)))
+    {
+        fail_values("EQUAL", capture(lhs), capture(rhs), lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_unequal(const T1& lhs, const T2& rhs, const char* lhs_str, const char* rhs_str, int line,
+                                  bool fatal = true)
+{
+    if (CCUT_UNLIKELY(!(lhs != rhs)))
+    {
+        fail_values("UNEQUAL", capture(lhs), capture(rhs), lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+static inline bool assert_almost_equal(long double lhs, long double rhs, const char* lhs_str, const char* rhs_str,
+                                       int line, bool fatal = true)
+{
+    static constexpr long double allowable_error = 0.0001;
+    long double real_error;
+    if (CCUT_UNLIKELY(!near_absolute(lhs, rhs, allowable_error, real_error)))
+    {
+        fail_values("ALMOST EQUAL", capture(lhs), capture(rhs), lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_near(const T1& lhs, const T2& rhs, long double tolerance, const char* lhs_str,
+                               const char* rhs_str, const char* tolerance_str, int line, bool fatal = true)
+{
+    long double difference;
+    if (CCUT_UNLIKELY(!near_absolute(lhs, rhs, tolerance, difference)))
+    {
+        fail_near(float_measure::absolute, lhs, rhs, sizeof(float_type<T1, T2>), difference, lhs_str,
+                  rhs_str, tolerance_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_near_relative(const T1& lhs, const T2& rhs, long double tolerance, const char* lhs_str,
+                                        const char* rhs_str, const char* tolerance_str, int line, bool fatal = true)
+{
+    long double difference;
+    if (CCUT_UNLIKELY(!near_relative(lhs, rhs, tolerance, difference)))
+    {
+        fail_near(float_measure::relative, lhs, rhs, sizeof(float_type<T1, T2>), difference, lhs_str,
+                  rhs_str, tolerance_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_near_ulps(const T1& lhs, const T2& rhs, uint64_t max_ulps, const char* lhs_str,
+                                    const char* rhs_str, const char* ulps_str, int line, bool fatal = true)
+{
+    typedef float_type<T1, T2> type;
+    uint64_t distance = ulp_distance<type>(static_cast<type>(lhs), static_cast<type>(rhs));
+    if (CCUT_UNLIKELY(distance > max_ulps))
+    {
+        fail_near(float_measure::ulps, lhs, rhs, sizeof(type), static_cast<long double>(distance), lhs_str, rhs_str,
+                  ulps_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_array_near(const T1* lhs, const T2* rhs, size_t count, long double tolerance,
+                                     const char* lhs_str, const char* rhs_str, const char* tolerance_str, int line,
+                                     bool fatal = true)
+{
+    typedef float_type<T1, T2> type;
+    size_t far = count_far(lhs, rhs, count, static_cast<type>(tolerance));
+    if (CCUT_UNLIKELY(far != 0))
+    {
+        size_t index = first_far(lhs, rhs, count, static_cast<type>(tolerance));
+        fail_array_near(lhs[index], rhs[index], sizeof(type), index, far, count, lhs_str, rhs_str,
+                        tolerance_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+static inline bool assert_bytes_equal(const void* lhs, const void* rhs, size_t size, const char* lhs_str,
+                                      const char* rhs_str, int line, bool fatal = true)
+{
+    size_t offset = bytes_mismatch(lhs, rhs, size);
+    if (CCUT_UNLIKELY(offset != size))
+    {
+        fail_bytes(lhs, rhs, size, offset, lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+// Capture the elements around a difference. Elements that iterators hand out
+// by value, such as std::vector<bool>'s, don't outlive the capture and so
+// aren't shown.
+template <typename It>
+CCUT_COLD static inline void capture_window(It it, size_t first, size_t shown, value_ref* refs)
+{
+    if constexpr (std::is_reference<decltype(*it)>::value)
+    {
+        for (size_t i = 0; i < first; ++i)
+        {
+            ++it;
+        }
+        for (size_t i = 0; i < shown; ++i, ++it)
+        {
+            refs[i] = capture(*it);
+        }
+    }
+}
+
+template <typename It1, typename It2>
+CCUT_COLD static inline void fail_range_values(const char* kind, const range_difference& where, It1 lhs, It2 rhs,
+                                               const char* lhs_str, const char* rhs_str, int line, bool fatal)
+{
+    value_ref lhs_refs[2 * range_context + 1] = {};
+    value_ref rhs_refs[2 * range_context + 1] = {};
+    range_difference shown = where;
+    if constexpr (!std::is_reference<decltype(*lhs)>::value || !std::is_reference<decltype(*rhs)>::value)
+        shown.lhs_shown = shown.rhs_shown = 0;
+    capture_window(lhs, shown.first, shown.lhs_shown, lhs_refs);
+    capture_window(rhs, shown.first, shown.rhs_shown, rhs_refs);
+    fail_range(kind, shown, lhs_refs, rhs_refs, lhs_str, rhs_str, line, fatal);
+}
+
+template <typename It1, typename It2>
+static inline bool assert_range_equal(It1 lhs_begin, It1 lhs_end, It2 rhs_begin, const char* lhs_str,
+                                      const char* rhs_str, int line, bool fatal = true)
+{
+    size_t size = range_size(lhs_begin, lhs_end);
+    size_t index = range_mismatch(lhs_begin, rhs_begin, size);
+    if (CCUT_UNLIKELY(index != size))
+    {
+        fail_range_values("RANGE EQUAL", locate_difference(index, size, size), lhs_begin, rhs_begin, lhs_str,
+                          rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename C1, typename C2>
+static inline bool assert_container_equal(const C1& lhs, const C2& rhs, const char* lhs_str, const char* rhs_str,
+                                          int line, bool fatal = true)
+{
+    size_t lhs_size = container_size(lhs);
+    size_t rhs_size = container_size(rhs);
+    size_t common = lhs_size < rhs_size ? lhs_size : rhs_size;
+    size_t index = range_mismatch(container_begin(lhs), container_begin(rhs), common);
+    if (CCUT_UNLIKELY(index != common || lhs_size != rhs_size))
+    {
+        fail_range_values("CONTAINER EQUAL", locate_difference(index, lhs_size, rhs_size), container_begin(lhs),
+                          container_begin(rhs), lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+static inline bool assert_thrown(bool expected, bool threw, const char* str, int line, bool fatal = true)
+{
+    if (CCUT_UNLIKELY(threw != expected))
+    {
+        fail_exception(expected, str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+} // namespace lean
+
+// Namespace of the checks the assertion macros call: the full header's,
+// once it is included, or else the lean ones above
+#if !defined(CCUT_FRAMEWORK_H)
+#define CCUT_CHECKS ccut_framework::lean
+#endif
+
+//                  //
+// Assertion Macros //
+//                  //
+
+#define CCUT_CONCAT_IMPL(x, y) x##y
+#define CCUT_CONCAT(x, y) CCUT_CONCAT_IMPL(x, y)
+
+// A failed fatal check leaves the test. With exceptions the check has already
+// thrown; without them the enclosing function returns, so ASSERT_* can only
+// be used in functions returning void.
+#if CCUT_NO_EXCEPTIONS
+#define CCUT_ASSERT(check)           \
+    do                               \
+    {                                \
+        if (CCUT_UNLIKELY(!(check))) \
+            return;                  \
+    } while (0)
+#else
+#define CCUT_ASSERT(check) (void)(check)
+#endif
+
+#define CCUT_EXPECT(check) (void)(check)
+
+#if CCUT_NO_EXCEPTIONS
+#define CCUT_ASSERT_EXCEPTION_IMPL(func_call, expected, fatal) \
+    static_assert(!sizeof(#func_call), "exception assertions need a build with exceptions")
+#else
+#define CCUT_DETERMINE_THROW(func_call, varname) \
+    bool varname = false;                        \
+    try                                          \
+    {                                            \
+        func_call;                               \
+    }                                            \
+    catch (const std::exception& e)              \
+    {                                            \
+        varname = true;                          \
+    }
+
+#define CCUT_ASSERT_EXCEPTION_IMPL(func_call, expected, fatal)                                  \
+    do                                                                                          \
+    {                                                                                           \
+        CCUT_DETERMINE_THROW(func_call, ccut_threw)                                             \
+        CCUT_CHECKS::assert_thrown(expected, ccut_threw, #func_call, __LINE__, fatal);          \
+    } while (0)
+#endif
+
+// ASSERT_* ends the test on failure
+#define ASSERT_TRUE( statement ) CCUT_ASSERT(CCUT_CHECKS::assert_true(statement, #statement, __LINE__))
+#define ASSERT_FALSE( statement ) CCUT_ASSERT(CCUT_CHECKS::assert_false(statement, #statement, __LINE__))
+#define ASSERT_EQUAL( lhs, rhs ) CCUT_ASSERT(CCUT_CHECKS::assert_equal(lhs, rhs, #lhs, #rhs, __LINE__))
+#define ASSERT_UNEQUAL( lhs, rhs ) CCUT_ASSERT(CCUT_CHECKS::assert_unequal(lhs, rhs, #lhs, #rhs, __LINE__))
+#define ASSERT_ALMOST_EQUAL( lhs, rhs ) CCUT_ASSERT(CCUT_CHECKS::assert_almost_equal(lhs, rhs, #lhs, #rhs, __LINE__))
+#define ASSERT_EXCEPTION( func_call ) CCUT_ASSERT_EXCEPTION_IMPL(func_call, true, true)
+#define ASSERT_NO_EXCEPTION( func_call ) CCUT_ASSERT_EXCEPTION_IMPL(func_call, false, true)
+
+// Floating point checks: within an absolute tolerance, within a tolerance
+// relative to the larger operand, and within a number of representable values
+#define ASSERT_NEAR( lhs, rhs, tolerance ) \
+    CCUT_ASSERT(CCUT_CHECKS::assert_near(lhs, rhs, tolerance, #lhs, #rhs, #tolerance, __LINE__))
+#define ASSERT_NEAR_REL( lhs, rhs, tolerance ) \
+    CCUT_ASSERT(CCUT_CHECKS::assert_near_relative(lhs, rhs, tolerance, #lhs, #rhs, #tolerance, __LINE__))
+#define ASSERT_NEAR_ULP( lhs, rhs, ulps ) \
+    CCUT_ASSERT(CCUT_CHECKS::assert_near_ulps(lhs, rhs, ulps, #lhs, #rhs, #ulps, __LINE__))
+
+// Compare count elements of two arrays within an absolute tolerance, as in
+// ASSERT_ARRAY_NEAR(out.data(), expected.data(), out.size(), 1e-6)
+#define ASSERT_ARRAY_NEAR( lhs, rhs, count, tolerance ) \
+    CCUT_ASSERT(CCUT_CHECKS::assert_array_near(lhs, rhs, count, tolerance, #lhs, #rhs, #tolerance, __LINE__))
+
+// Bulk comparisons, reporting where the operands first differ and what is
+// around it. ASSERT_RANGE_EQUAL compares [begin, end) with as many elements
+// from begin2 on; ASSERT_CONTAINER_EQUAL needs equal sizes too.
+#define ASSERT_BYTES_EQUAL( lhs, rhs, size ) \
+    CCUT_ASSERT(CCUT_CHECKS::assert_bytes_equal(lhs, rhs, size, #lhs, #rhs, __LINE__))
+#define ASSERT_RANGE_EQUAL( begin, end, begin2 ) \
+    CCUT_ASSERT(CCUT_CHECKS::assert_range_equal(begin, end, begin2, #begin ", " #end, #begin2, __LINE__))
+#define ASSERT_CONTAINER_EQUAL( lhs, rhs ) \
+    CCUT_ASSERT(CCUT_CHECKS::assert_container_equal(lhs, rhs, #lhs, #rhs, __LINE__))
+
+// EXPECT_* records the failure and lets the test carry on
+#define EXPECT_TRUE( statement ) CCUT_EXPECT(CCUT_CHECKS::assert_true(statement, #statement, __LINE__, false))
+#define EXPECT_FALSE( statement ) CCUT_EXPECT(CCUT_CHECKS::assert_false(statement, #statement, __LINE__, false))
+#define EXPECT_EQUAL( lhs, rhs ) CCUT_EXPECT(CCUT_CHECKS::assert_equal(lhs, rhs, #lhs, #rhs, __LINE__, false))
+#define EXPECT_UNEQUAL( lhs, rhs ) CCUT_EXPECT(CCUT_CHECKS::assert_unequal(lhs, rhs, #lhs, #rhs, __LINE__, false))
+#define EXPECT_ALMOST_EQUAL( lhs, rhs ) CCUT_EXPECT(CCUT_CHECKS::assert_almost_equal(lhs, rhs, #lhs, #rhs, __LINE__, false))
+#define EXPECT_EXCEPTION( func_call ) CCUT_ASSERT_EXCEPTION_IMPL(func_call, true, false)
+#define EXPECT_NO_EXCEPTION( func_call ) CCUT_ASSERT_EXCEPTION_IMPL(func_call, false, false)
+#define EXPECT_NEAR( lhs, rhs, tolerance ) \
+    CCUT_EXPECT(CCUT_CHECKS::assert_near(lhs, rhs, tolerance, #lhs, #rhs, #tolerance, __LINE__, false))
+#define EXPECT_NEAR_REL( lhs, rhs, tolerance ) \
+    CCUT_EXPECT(CCUT_CHECKS::assert_near_relative(lhs, rhs, tolerance, #lhs, #rhs, #tolerance, __LINE__, false))
+#define EXPECT_NEAR_ULP( lhs, rhs, ulps ) \
+    CCUT_EXPECT(CCUT_CHECKS::assert_near_ulps(lhs, rhs, ulps, #lhs, #rhs, #ulps, __LINE__, false))
+#define EXPECT_ARRAY_NEAR( lhs, rhs, count, tolerance ) \
+    CCUT_EXPECT(CCUT_CHECKS::assert_array_near(lhs, rhs, count, tolerance, #lhs, #rhs, #tolerance, __LINE__, false))
+#define EXPECT_BYTES_EQUAL( lhs, rhs, size ) \
+    CCUT_EXPECT(CCUT_CHECKS::assert_bytes_equal(lhs, rhs, size, #lhs, #rhs, __LINE__, false))
+#define EXPECT_RANGE_EQUAL( begin, end, begin2 ) \
+    CCUT_EXPECT(CCUT_CHECKS::assert_range_equal(begin, end, begin2, #begin ", " #end, #begin2, __LINE__, false))
+#define EXPECT_CONTAINER_EQUAL( lhs, rhs ) \
+    CCUT_EXPECT(CCUT_CHECKS::assert_container_equal(lhs, rhs, #lhs, #rhs, __LINE__, false))
+
+//             //
+// Test Macros //
+//             //
+
+#define CCUT_EXPAND(x) x
+#define CCUT_FIRST(first, ...) first
+#define CCUT_REST(first, ...) __VA_ARGS__
+
+#define CCUT_TEST_IMPL(funcname, serial, ...)                                                                    \
+    static inline void funcname();                                                           /* declare test */  \
+    static const char* const ccut_tags_##funcname[] = {__VA_ARGS__};                         /* tag list */      \
+    static ccut_framework::RegisterTest register_ccut_##funcname(#funcname, &funcname, serial, \
+                                                                 ccut_tags_##funcname);      /* register test */ \
+    void funcname()                                                                          /* implement test */
+
+// Expands the split-up TEST() arguments before they reach CCUT_TEST_IMPL()
+#define CCUT_TEST_EXPANDED(...) CCUT_EXPAND(CCUT_TEST_IMPL(__VA_ARGS__))
+
+// Declare a new test function, optionally followed by string tags to select
+// it with, as in TEST(parses_header, "fast", "io"). A "timeout=<duration>"
+// tag, as in TEST(syncs, "timeout=2s"), overrides --timeout for the test.
+#define TEST(...) CCUT_TEST_EXPANDED(CCUT_FIRST(__VA_ARGS__, ~), false, CCUT_REST(__VA_ARGS__, nullptr))
+
+// Declare a new test function that is never run concurrently with other tests
+#define TEST_SERIAL(...) CCUT_TEST_EXPANDED(CCUT_FIRST(__VA_ARGS__, ~), true, CCUT_REST(__VA_ARGS__, nullptr))
+
+// Declare a new benchmark, whose body is the operation being measured. It is
+// only run when the test binary is given --bench.
+#define BENCHMARK(name)                                                                                           \
+    static inline void name();                                                                /* declare bench */  \
+    static ccut_framework::RegisterBenchmark register_ccut_bench_##name(#name, &name);        /* register bench */ \
+    void name()                                                                               /* implement bench */
+
+} // namespace ccut_framework
+
+#endif // ifndef CCUT_CORE_H
@@ -1,21 +1,87 @@
 #ifndef CCUT_FRAMEWORK_H
 #define CCUT_FRAMEWORK_H
 
-#include <map>
 #include <vector>
 #include <initializer_list>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <sstream>
 #include <exception>
 #include <cassert>
+#include <cstdlib>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cstdio>
+#include <chrono>
+#include <ctime>
+#include <cmath>
+#include <atomic>
+#include <random>
+
+#include <memory>
+#include <type_traits>
+#include <new>
+#include <array>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <functional>
+
+// Async tests need C++20 coroutines
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <optional>
+#define CCUT_HAS_COROUTINES 1
+#else
+#define CCUT_HAS_COROUTINES 0
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CCUT_POSIX 1
+#else
+#define CCUT_POSIX 0
+#endif
+
+// Process isolation needs POSIX fork() and pipes
+#if !defined(CCUT_HAS_FORK)
+#define CCUT_HAS_FORK CCUT_POSIX
+#endif
+
+#if CCUT_POSIX
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <regex.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#endif
+
+#include "ccut_core.h"
+
+// The assertion macros use the checks below, which can show any value
+#undef CCUT_CHECKS
+#define CCUT_CHECKS ccut_framework
 
 namespace ccut_framework
 {
 
-// Test function type
-typedef void(*test_func_t)();
-
 // Helpful reference for terminal formatting
 enum class colors
 {
@@ -65,19 +131,145 @@ static inline std::ostream& operator<<(std::ostream& os, std::initializer_list<c
     return os << ansi(codes);
 }
 
-// All tests to be run in test_main()
-static std::map<std::string, test_func_t> tests;
+// Take the next top-level argument from the stringized argument list of a
+// macro, trimming the space around it. The list is set to null after its last
+// argument, and false is returned once it is exhausted.
+static inline bool next_macro_arg(const char*& list, const char*& begin, const char*& end)
+{
+    if (!list)
+        return false;
+
+    int depth = 0;
+    const char* c = list;
+    for (; *c && (*c != ',' || depth > 0); c++)
+    {
+        // Skip over string and character literals, which may hold commas
+        if (*c == '"' || *c == '\'')
+        {
+            char quote = *c;
+            while (c[1] && c[1] != quote)
+                c += c[1] == '\\' && c[2] ? 2 : 1;
+            if (c[1])
+                c++;
+        }
+        else if (*c == '(' || *c == '<' || *c == '[' || *c == '{')
+            depth++;
+        else if ((*c == ')' || *c == '>' || *c == ']' || *c == '}') && depth > 0)
+            depth--;
+    }
+
+    begin = list;
+    end = c;
+    while (begin < end && *begin == ' ')
+        begin++;
+    while (end > begin && end[-1] == ' ')
+        end--;
+    list = *c ? c + 1 : nullptr;
+    return true;
+}
 
-// Register a new test
-class RegisterTest
+// Register the instances of a typed or parameterized test, each named after
+// the test and the macro argument it was instantiated with: "name<float>" for
+// TYPED_TEST() and "name/4096" for TEST_P(). Only the names are built at
+// startup, all into one buffer, and the nodes share one allocation, so a test
+// with thousands of instances costs a handful of allocations to register.
+class RegisterTestInstances
 {
-public:
-    inline RegisterTest(std::string name, test_func_t func)
+protected:
+    inline RegisterTestInstances(const char* name, const char* arg_list, const char* open, const char* close,
+                                 const test_func_t* funcs, size_t count)
     {
-        tests.emplace(name, func);
+        size_t name_len = std::strlen(name);
+        names.reserve(count * (name_len + std::strlen(open) + std::strlen(close) + 8));
+        for (size_t i = 0; i < count; i++)
+        {
+            const char* begin;
+            const char* end;
+            names.append(name, name_len).append(open);
+            if (next_macro_arg(arg_list, begin, end))
+                names.append(begin, end);
+            else
+                names.append(std::to_string(i));
+            names.append(close).push_back('\0');
+        }
+
+        // The buffer has stopped growing, so names can now point into it, and
+        // the nodes never move since they are all reserved up front
+        tests.reserve(count);
+        for (const char* instance = names.data(); tests.size() < count; instance += std::strlen(instance) + 1)
+        {
+            tests.emplace_back(instance, funcs[tests.size()]);
+        }
     }
+
+private:
+    std::string names; // Each instance's name, null-terminated, one after another
+    std::vector<RegisterTest> tests;
+};
+
+// Register Test<T>::run for each of the given types
+template <template <typename> class Test, typename... Types>
+class RegisterTypedTest : RegisterTestInstances
+{
+public:
+    inline RegisterTypedTest(const char* name, const char* type_list)
+        : RegisterTestInstances(name, type_list, "<", ">", funcs, sizeof...(Types))
+    {}
+
+private:
+    static constexpr test_func_t funcs[] = {&Test<Types>::run...};
 };
 
+// The type a TEST_P()'s values are stored as; string literals become const char*
+template <typename... Values>
+using param_type = typename std::common_type<typename std::decay<const Values>::type...>::type;
+
+// The values of a TEST_P(), converted to their common type
+template <typename... Values>
+constexpr std::array<param_type<Values...>, sizeof...(Values)> param_values(const Values&... values)
+{
+    return {{static_cast<param_type<Values...>>(values)...}};
+}
+
+// Register Test::run<I> for each index into Test::values
+template <typename Test, typename Indices = std::make_index_sequence<Test::values.size()>>
+class RegisterParamTest;
+
+template <typename Test, size_t... I>
+class RegisterParamTest<Test, std::index_sequence<I...>> : RegisterTestInstances
+{
+public:
+    inline RegisterParamTest(const char* name, const char* value_list)
+        : RegisterTestInstances(name, value_list, "/", "", funcs, sizeof...(I))
+    {}
+
+private:
+    static constexpr test_func_t funcs[] = {&Test::template run<I>...};
+};
+
+// Sort registry nodes by name, keeping nodes of the same name in list order
+template <typename Node>
+static inline void sort_by_name(std::vector<const Node*>& nodes)
+{
+    std::stable_sort(nodes.begin(), nodes.end(), [](const Node* a, const Node* b) {
+        return std::strcmp(a->name, b->name) < 0;
+    });
+}
+
+// Collect a registry's nodes sorted by name
+template <typename Node>
+static inline std::vector<const Node*> sorted_nodes(const registry_list<Node>& list)
+{
+    std::vector<const Node*> nodes;
+    nodes.reserve(list.size);
+    for (const Node* node = list.head; node; node = node->next)
+    {
+        nodes.push_back(node);
+    }
+    sort_by_name(nodes);
+    return nodes;
+}
+
 // Custom exception class
 class ccut_exception
 {
@@ -94,175 +286,6796 @@ public:
         return os.str();
     }
 
+    inline const std::string& get_reason() const
+    {
+        return reason;
+    }
+
+    inline int get_line() const
+    {
+        return line;
+    }
+
 private:
     std::string reason;
     int line;
 };
 
-// Run all tests
-static inline int test_main()
+// First failure recorded by the running test, from EXPECT_* or from ASSERT_*
+// in builds without exceptions. Later failures are only counted.
+struct failure_slot
 {
-    // Determine maximum test name length
-    size_t max_name_len = 0;
-    for (const auto& test : tests)
+    bool failed = false;
+    std::string reason;
+    int line = 0;
+    unsigned count = 0;
+};
+
+// The calling thread's slot. Like the registries, this is a non-static inline
+// function so tests in every translation unit share it with the runner.
+inline failure_slot& current_failure()
+{
+    static thread_local failure_slot slot;
+    return slot;
+}
+
+// Record a failure without leaving the test
+static inline void record_failure(failure_slot& slot, std::string reason, int line)
+{
+    if (!slot.failed)
+    {
+        slot.failed = true;
+        slot.reason = std::move(reason);
+        slot.line = line;
+    }
+    slot.count++;
+}
+
+// A failure recorded on a thread other than the test's own
+struct thread_failure
+{
+    std::string reason;
+    int line;
+    thread_failure* next;
+};
+
+// Failures from any number of threads, pushed without locking and taken all
+// at once when the test has finished
+struct failure_list
+{
+    std::atomic<thread_failure*> head{nullptr};
+
+    inline void push(std::string reason, int line)
+    {
+        thread_failure* node = new thread_failure{std::move(reason), line, head.load(std::memory_order_relaxed)};
+        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Record every failure into a slot, oldest first
+    inline void take(failure_slot& slot)
+    {
+        thread_failure* node = head.exchange(nullptr, std::memory_order_acquire);
+        thread_failure* oldest = nullptr;
+        while (node)
+        {
+            thread_failure* next = node->next;
+            node->next = oldest;
+            oldest = node;
+            node = next;
+        }
+        while (oldest)
+        {
+            std::unique_ptr<thread_failure> done(oldest);
+            oldest = oldest->next;
+            record_failure(slot, std::move(done->reason), done->line);
+        }
+    }
+};
+
+// What a running test shares with the threads working for it
+struct test_context
+{
+    failure_list failures;              // From threads other than the test's own
+    std::atomic<bool> cancelled{false}; // Set by the test's first failure on any thread
+};
+
+// Which test the calling thread works for. The runner binds its threads to
+// each test while it runs, and test_thread and test_scope bind others.
+struct thread_binding
+{
+    test_context* context = nullptr;
+    bool own = false;     // The test's own thread, whose failures go to current_failure()
+    bool catches = false; // Something above the test code catches ccut_exception
+};
+
+inline thread_binding& current_binding()
+{
+    static thread_local thread_binding binding;
+    return binding;
+}
+
+// Failures from threads bound to no test, such as a plain std::thread's.
+// The next test to finish takes them, which with one job at a time is the
+// test that started the thread.
+CCUT_CONSTINIT inline failure_list stray_failures;
+
+// Record a failure without leaving the test, wherever the calling thread's
+// failures go, and cancel the test
+static inline void record_failure(std::string reason, int line)
+{
+    thread_binding& binding = current_binding();
+    if (binding.context)
+        binding.context->cancelled.store(true, std::memory_order_relaxed);
+
+    if (binding.own)
+        record_failure(current_failure(), std::move(reason), line);
+    else if (binding.context)
+        binding.context->failures.push(std::move(reason), line);
+    else
+        stray_failures.push("On a thread bound to no test: " + reason, line);
+}
+
+// Bind the calling thread to a test, or a test's own thread to its test, for
+// the binder's lifetime
+class bind_thread
+{
+public:
+    inline bind_thread(test_context* context, bool own, bool catches)
+        : saved(current_binding())
+    {
+        current_binding() = {context, own, catches};
+    }
+
+    inline ~bind_thread()
+    {
+        current_binding() = saved;
+    }
+
+    bind_thread(const bind_thread&) = delete;
+    bind_thread& operator=(const bind_thread&) = delete;
+
+private:
+    thread_binding saved;
+};
+
+// Gather what the other threads of a test recorded once it has finished. Its
+// own thread's failures come first, since the order between threads is not
+// known.
+static inline void take_thread_failures(test_context& context, failure_slot& slot)
+{
+    context.failures.take(slot);
+    if (stray_failures.head.load(std::memory_order_relaxed))
+        stray_failures.take(slot);
+}
+
+//              //
+// Test Threads //
+//              //
+
+// Identifies the running test, to hand to threads that should work for it
+struct test_handle
+{
+    test_context* context;
+};
+
+// The test the calling thread works for, or an empty handle if none
+static inline test_handle current_test()
+{
+    return {current_binding().context};
+}
+
+// Whether the test the calling thread works for has failed on any thread.
+// Long-running work started by a test can poll this to stop early. On a
+// thread bound to no test, this is whether any such thread has failed.
+static inline bool test_cancelled()
+{
+    test_context* context = current_binding().context;
+    if (context)
+        return context->cancelled.load(std::memory_order_relaxed);
+    return stray_failures.head.load(std::memory_order_relaxed) != nullptr;
+}
+
+// Makes assertions on the calling thread fail the given test, for threads
+// the test didn't start itself, like a thread pool's. A failed ASSERT_* on
+// such a thread only records the failure and cancels the test, since an
+// exception would have nowhere to go; the code should check test_cancelled().
+// The test must still be running when the scope ends.
+class test_scope
+{
+public:
+    inline explicit test_scope(test_handle test)
+        : binding(test.context, false, false)
+    {}
+
+private:
+    bind_thread binding;
+};
+
+// A thread working for the running test, to use in place of std::thread.
+// Assertions on it fail the test instead of ending the process: a failed
+// ASSERT_* returns from the thread's function and cancels the test, as does
+// an exception escaping it. Joins on destruction, so a test can't finish
+// while its threads are still running, and cancels the test first if the
+// test is ending by a failure or exception of its own.
+class test_thread
+{
+public:
+    template <typename Func, typename... Args>
+    inline explicit test_thread(Func&& func, Args&&... args)
+        : thread(&test_thread::run<typename std::decay<Func>::type, typename std::decay<Args>::type...>,
+                 current_binding().context, std::forward<Func>(func), std::forward<Args>(args)...)
+    {}
+
+    test_thread(test_thread&&) = default;
+    test_thread& operator=(test_thread&& other)
+    {
+        finish();
+        thread = std::move(other.thread);
+        return *this;
+    }
+
+    inline ~test_thread()
     {
-        max_name_len = std::max(test.first.size(), max_name_len);
+        finish();
     }
 
-    //                    funcname     reason
-    std::vector<std::pair<std::string, std::string>> failures;
+    inline void join()
+    {
+        thread.join();
+    }
 
-    // Run all tests
-    for (const auto& test : tests)
+    inline bool joinable() const
     {
-        size_t spaces = max_name_len - test.first.size();
-        std::cout << "Running test \"" << test.first << "\"" << std::string(spaces, ' ') << " . . . ";
+        return thread.joinable();
+    }
 
+private:
+    template <typename Func, typename... Args>
+    static void run(test_context* context, Func func, Args... args)
+    {
+        bind_thread binding(context, false, true);
+#if CCUT_NO_EXCEPTIONS
+        std::invoke(std::move(func), std::move(args)...);
+#else
         try
         {
-            test.second();
-            std::cout << colors::green << "PASS\n" << colors::none;
+            std::invoke(std::move(func), std::move(args)...);
         }
-        catch (const ccut_exception& ce)
+        catch (const ccut_exception&)
         {
-            std::cout << colors::red << "FAIL\n" << colors::none;
-            failures.push_back({test.first, ce.what()});
+            // Recorded before it was thrown
         }
         catch (const std::exception& e)
         {
-            std::cout << colors::yellow << "EXCEPTION\n" << colors::none;
-            failures.push_back({test.first, std::string("Unexpected std::exception: \"") + e.what() + '"'});
+            record_failure(std::string("Unexpected std::exception on a test thread: \"") + e.what() + '"', 0);
         }
         catch (...)
         {
-            std::cout << ansi({colors::red, colors::bold}) << "UNRECOGNIZED EXCEPTION\n" << colors::none;
-            failures.push_back({test.first, "Totally unknown error was thrown!"});
+            record_failure("Totally unknown error was thrown on a test thread!", 0);
         }
+#endif
     }
 
-    // Print failure reasons, if any
-    if (failures.size())
+    inline void finish()
     {
-        std::cout << "\n- - - Failures - - -\n";
-        for (const auto& fail : failures)
-        {
-            //                  [function name]         why it failed
-            std::cout << " -> [" << fail.first << "] " << fail.second << "\n";
-        }
+        if (!thread.joinable())
+            return;
+#if !CCUT_NO_EXCEPTIONS
+        test_context* context = current_binding().context;
+        if (context && std::uncaught_exceptions())
+            context->cancelled.store(true, std::memory_order_relaxed);
+#endif
+        thread.join();
     }
-    std::cout << "\n";
 
-    // Print overall summary
-    std::cout << "Total passed: [" << tests.size() - failures.size() << " / " << tests.size() << "]\n";
+    std::thread thread;
+};
+
+//        //
+// Clocks //
+//        //
+
+// Monotonic wall-clock time in nanoseconds
+static inline uint64_t wall_now_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
 
-    return 0;
+// CPU time used by the calling thread in nanoseconds. Without a per-thread
+// clock this falls back to process CPU time, which overlaps between jobs.
+static inline uint64_t cpu_now_ns()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+#else
+    return static_cast<uint64_t>(std::clock()) * (1000000000u / CLOCKS_PER_SEC);
+#endif
 }
 
 //                     //
-// Assertion Functions //
+// Allocation Tracking //
 //                     //
 
-static inline void assert_true(bool expr, std::string str, int line)
+// Heap use by the calling thread. Counting only happens with operator new
+// replaced, by defining CCUT_TRACK_ALLOCS where TEST_MAIN() is used, and only
+// while a test body runs outside the framework's own bookkeeping.
+struct alloc_counters
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    bool armed = false; // A test body is running
+    unsigned paused = 0; // Inside framework code within a test body
+};
+
+// Shared by every translation unit, like the registries. Constant
+// initialized, so reaching it from operator new never allocates.
+inline alloc_counters& thread_allocs()
 {
-    if (!expr)
-        throw ccut_exception("Expected TRUE, but was FALSE: \"" + str + '"', line);
+    static thread_local alloc_counters counters;
+    return counters;
 }
 
-static inline void assert_false(bool expr, std::string str, int line)
+// Whether operator new has been replaced to count allocations
+inline bool& alloc_tracking()
 {
-    if (expr)
-        throw ccut_exception("Expected FALSE, but was TRUE: \"" + str + '"', line);
+    static bool enabled = false;
+    return enabled;
 }
 
-template <typename T1, typename T2>
-static inline void assert_equal(const T1& lhs, const T2& rhs, std::string lhs_str, std::string rhs_str, int line)
+// Leave the framework's own allocations out of a test's counts
+class untracked_allocs
 {
-    if (!(lhs == rhs))
+public:
+    inline untracked_allocs()
     {
-        std::ostringstream os;
-        os << "Expected EQUAL, but was NOT EQUAL: [" << lhs_str << "]"
-           << " and [" << rhs_str << "]";
-        throw ccut_exception(os.str(), line);
+        thread_allocs().paused++;
     }
-}
 
-template <typename T1, typename T2>
-static inline void assert_unequal(const T1& lhs, const T2& rhs, std::string lhs_str, std::string rhs_str, int line)
+    inline ~untracked_allocs()
+    {
+        thread_allocs().paused--;
+    }
+
+    untracked_allocs(const untracked_allocs&) = delete;
+    untracked_allocs& operator=(const untracked_allocs&) = delete;
+};
+
+static inline void count_alloc(size_t size)
 {
-    if (!(lhs != rhs))
+    alloc_counters& counters = thread_allocs();
+    if (counters.armed && !counters.paused)
     {
-        std::ostringstream os;
-        os << "Expected UNEQUAL, but was NOT UNEQUAL: [" << lhs_str << "]"
-           << " and [" << rhs_str << "]";
-        throw ccut_exception(os.str(), line);
+        counters.count++;
+        counters.bytes += size;
     }
 }
 
-static inline void assert_almost_equal(long double lhs, long double rhs, std::string lhs_str, std::string rhs_str, int line)
+// Bodies of the replacement operators defined by CCUT_ALLOC_HOOKS
+static inline void* tracked_new(size_t size)
 {
-    static constexpr long double allowable_error = 0.0001;
-    double real_error = std::abs(lhs - rhs);
-    if (real_error > allowable_error)
+    count_alloc(size);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+#if CCUT_NO_EXCEPTIONS
+    std::abort();
+#else
+    throw std::bad_alloc();
+#endif
+}
+
+static inline void* tracked_aligned_new(size_t size, std::align_val_t align)
+{
+    count_alloc(size);
+    size_t alignment = std::max(static_cast<size_t>(align), sizeof(void*));
+#if defined(_MSC_VER)
+    if (void* ptr = ::_aligned_malloc(size ? size : 1, alignment))
+        return ptr;
+#else
+    void* ptr = nullptr;
+    if (::posix_memalign(&ptr, alignment, size ? size : 1) == 0)
+        return ptr;
+#endif
+#if CCUT_NO_EXCEPTIONS
+    std::abort();
+#else
+    throw std::bad_alloc();
+#endif
+}
+
+// GCC sees these free() memory from operator new once inlined into it
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static inline void tracked_delete(void* ptr)
+{
+    std::free(ptr);
+}
+
+static inline void tracked_aligned_delete(void* ptr)
+{
+#if defined(_MSC_VER)
+    ::_aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+//                   //
+// Hardware Counters //
+//                   //
+
+// Events that --counters can measure
+enum class hw_event : uint8_t
+{
+    cycles,
+    instructions,
+    cache_references,
+    cache_misses,
+    branches,
+    branch_misses,
+};
+
+static constexpr const char* hw_event_names[] = {
+    "cycles", "instructions", "cache-references", "cache-misses", "branches", "branch-misses",
+};
+
+// A group is only meaningful while the PMU can hold all of it at once, so
+// there is a limit on how many events are measured together
+static constexpr size_t max_hw_counters = 6;
+
+using counter_values = std::array<uint64_t, max_hw_counters>;
+
+// Events measured around every test and benchmark body, in the order their
+// counts are stored. Empty unless --counters was given and works here.
+inline std::vector<hw_event>& hw_events()
+{
+    static std::vector<hw_event> events;
+    return events;
+}
+
+// A perf_event group counting the calling thread in user space. The group is
+// opened once, then only reset, enabled and disabled around each measurement,
+// which keeps the cost inside the measured time down to two ioctl calls.
+class counter_group
+{
+public:
+    inline counter_group() = default;
+
+    inline ~counter_group()
     {
-        std::ostringstream os;
-        os << "Expected ALMOST EQUAL, but was NOT ALMOST EQUAL: [" << lhs_str << "]"
-           << " and [" << rhs_str << "]";
-        throw ccut_exception(os.str(), line);
+        close();
     }
-}
 
-#define CCUT_DETERMINE_THROW(func_call, varname) \
-    bool varname = false;                        \
-    try                                          \
-    {                                            \
-        func_call;                               \
-    }                                            \
-    catch (const std::exception& e)              \
-    {                                            \
-        varname = true;                          \
+    counter_group(const counter_group&) = delete;
+    counter_group& operator=(const counter_group&) = delete;
+
+    // Returns false with a reason if the events can't all be counted
+    inline bool open(const std::vector<hw_event>& events, std::string& error)
+    {
+        close();
+#if defined(__linux__)
+        static constexpr uint64_t configs[] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+        };
+        for (hw_event event : events)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[static_cast<size_t>(event)];
+            attr.disabled = count == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            int leader = count ? fds[0] : -1;
+            int fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+            if (fd < 0)
+            {
+                error = std::string(hw_event_names[static_cast<size_t>(event)]) + ": " + std::strerror(errno);
+                close();
+                return false;
+            }
+            fds[count++] = fd;
+        }
+        return true;
+#else
+        (void)events;
+        error = "perf_event_open is only available on Linux";
+        return false;
+#endif
     }
 
-#define CCUT_CONCAT_IMPL(x, y) x##y
-#define CCUT_CONCAT(x, y) CCUT_CONCAT_IMPL(x, y)
+    inline bool is_open() const
+    {
+        return count != 0;
+    }
 
-#define CCUT_ASSERT_EXCEPTION_IMPL(func_call)                                      \
-    CCUT_DETERMINE_THROW(func_call, CCUT_CONCAT(ccut_threw_, __LINE__))            \
-    if (!CCUT_CONCAT(ccut_threw_, __LINE__))                                       \
-    {                                                                              \
-        std::ostringstream os;                                                     \
-        os << "Expected EXCEPTION, but got NO EXCEPTION: \"" << #func_call << '"'; \
-        throw ccut_framework::ccut_exception(os.str(), __LINE__);                  \
+    inline void start()
+    {
+#if defined(__linux__)
+        if (count)
+        {
+            ::ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ::ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
     }
 
-#define CCUT_ASSERT_NO_EXCEPTION_IMPL(func_call)                                   \
-    CCUT_DETERMINE_THROW(func_call, CCUT_CONCAT(ccut_threw_, __LINE__))            \
-    if (CCUT_CONCAT(ccut_threw_, __LINE__))                                        \
-    {                                                                              \
-        std::ostringstream os;                                                     \
-        os << "Expected NO EXCEPTION, but got EXCEPTION: \"" << #func_call << '"'; \
-        throw ccut_framework::ccut_exception(os.str(), __LINE__);                  \
+    // Counts since start(), scaled up if the kernel had to multiplex the group
+    inline void stop(counter_values& values)
+    {
+#if defined(__linux__)
+        if (!count)
+            return;
+        ::ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // Laid out as count, time enabled, time running, then each value
+        uint64_t data[3 + max_hw_counters];
+        ssize_t size = ::read(fds[0], data, sizeof(data));
+        if (size < static_cast<ssize_t>((3 + count) * sizeof(uint64_t)) || !data[2])
+            return;
+        for (size_t i = 0; i < count; i++)
+        {
+            values[i] = data[2] < data[1]
+                ? static_cast<uint64_t>(static_cast<long double>(data[3 + i]) * data[1] / data[2])
+                : data[3 + i];
+        }
+#else
+        (void)values;
+#endif
     }
 
-//                  //
-// Assertion Macros //
-//                  //
+private:
+    inline void close()
+    {
+#if CCUT_POSIX
+        for (size_t i = count; i > 0; i--)
+        {
+            ::close(fds[i - 1]);
+        }
+#endif
+        count = 0;
+    }
+
+    int fds[max_hw_counters] = {};
+    size_t count = 0;
+};
+
+// The calling thread's counters, opened the first time the thread measures
+// anything. Worker threads and shard processes each get their own this way.
+static inline counter_group& thread_counters()
+{
+    static thread_local struct lazy_group
+    {
+        counter_group group;
+        inline lazy_group()
+        {
+            std::string error;
+            if (!hw_events().empty())
+                group.open(hw_events(), error);
+        }
+    } lazy;
+    return lazy.group;
+}
+
+// Format an event count with a metric prefix
+static inline std::string format_count(double count)
+{
+    std::ostringstream os;
+    os.setf(std::ios::fixed);
+    os.precision(count < 1e3 && count == std::floor(count) ? 0 : 2);
+    if (count < 1e3)
+        os << count;
+    else if (count < 1e6)
+        os << count / 1e3 << "k";
+    else if (count < 1e9)
+        os << count / 1e6 << "M";
+    else
+        os << count / 1e9 << "G";
+    return os.str();
+}
+
+// Describe counts, per call if given a unit such as "/op", with IPC and miss
+// rates for the events that have something to compare against. Misses are
+// a percentage of their references, or per 1000 instructions without them.
+static inline std::string describe_counters(const std::vector<hw_event>& events, const double* values, const char* unit)
+{
+    auto find = [&](hw_event event) -> const double* {
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            if (events[i] == event)
+                return &values[i];
+        }
+        return nullptr;
+    };
+    const double* cycles = find(hw_event::cycles);
+    const double* instructions = find(hw_event::instructions);
+
+    std::ostringstream os;
+    os.setf(std::ios::fixed);
+    os.precision(2);
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        if (i)
+            os << ", ";
+        os << format_count(values[i]) << " " << hw_event_names[static_cast<size_t>(events[i])] << unit;
+
+        const double* total = nullptr;
+        if (events[i] == hw_event::cache_misses)
+            total = find(hw_event::cache_references);
+        else if (events[i] == hw_event::branch_misses)
+            total = find(hw_event::branches);
+
+        if (events[i] == hw_event::instructions && cycles && *cycles > 0)
+            os << " (IPC " << values[i] / *cycles << ")";
+        else if (total && *total > 0)
+            os << " (" << 100 * values[i] / *total << "%)";
+        else if ((events[i] == hw_event::cache_misses || events[i] == hw_event::branch_misses) && instructions
+                 && *instructions > 0)
+            os << " (" << 1000 * values[i] / *instructions << " per 1k instructions)";
+    }
+    return os.str();
+}
 
-#define ASSERT_TRUE( statement ) ccut_framework::assert_true(statement, #statement, __LINE__)
-#define ASSERT_FALSE( statement ) ccut_framework::assert_false(statement, #statement, __LINE__)
-#define ASSERT_EQUAL( lhs, rhs ) ccut_framework::assert_equal(lhs, rhs, #lhs, #rhs, __LINE__)
-#define ASSERT_UNEQUAL( lhs, rhs ) ccut_framework::assert_unequal(lhs, rhs, #lhs, #rhs, __LINE__)
-#define ASSERT_ALMOST_EQUAL( lhs, rhs ) ccut_framework::assert_almost_equal(lhs, rhs, #lhs, #rhs, __LINE__)
-#define ASSERT_EXCEPTION( func_call ) CCUT_ASSERT_EXCEPTION_IMPL(func_call)
-#define ASSERT_NO_EXCEPTION( func_call ) CCUT_ASSERT_NO_EXCEPTION_IMPL(func_call)
+//           //
+// Reporting //
+//           //
+
+#if CCUT_POSIX
+// Write a whole buffer, retrying on partial writes and interrupts
+static inline bool write_all(int fd, const char* data, size_t size)
+{
+    while (size)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+#endif
+
+// Report text is formatted into a preallocated buffer and written out with
+// one write(2) per batch, so reporting takes no locks and does no iostream
+// work. Each thread has its own buffer for stdout and only ever flushes that
+// one, and every flush is a single write of whole report text.
+class out_buffer
+{
+public:
+    static constexpr size_t capacity = 1 << 16;
+
+    // Batches older than this are flushed at the next sync point
+    static constexpr uint64_t stale_ns = 100000000;
+
+#if CCUT_POSIX
+    typedef int target_type;
+#else
+    typedef std::FILE* target_type;
+#endif
+
+    // Buffer for stdout
+    inline out_buffer()
+        : out_buffer(stdout_target(), false)
+    {}
+
+    inline ~out_buffer()
+    {
+        flush();
+        if (owns_target)
+        {
+#if CCUT_POSIX
+            ::close(target);
+#else
+            std::fclose(target);
+#endif
+        }
+    }
+
+    // Buffer for a newly created or truncated file, or null if it can't be opened
+    static inline std::unique_ptr<out_buffer> open(const char* path)
+    {
+#if CCUT_POSIX
+        int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return nullptr;
+        return std::unique_ptr<out_buffer>(new out_buffer(fd, true));
+#else
+        std::FILE* file = std::fopen(path, "wb");
+        if (!file)
+            return nullptr;
+        return std::unique_ptr<out_buffer>(new out_buffer(file, true));
+#endif
+    }
+
+    out_buffer(const out_buffer&) = delete;
+    out_buffer& operator=(const out_buffer&) = delete;
+
+    inline out_buffer& append(const char* str, size_t len)
+    {
+        if (size + len > capacity)
+        {
+            flush();
+            if (len > capacity)
+            {
+                write_out(str, len);
+                return *this;
+            }
+        }
+        std::memcpy(data.get() + size, str, len);
+        size += len;
+        return *this;
+    }
+
+    inline out_buffer& operator<<(const char* str)
+    {
+        return append(str, std::strlen(str));
+    }
+
+    inline out_buffer& operator<<(const std::string& str)
+    {
+        return append(str.data(), str.size());
+    }
+
+    inline out_buffer& operator<<(char c)
+    {
+        return append(&c, 1);
+    }
+
+    template <typename T>
+    inline typename std::enable_if<std::is_integral<T>::value, out_buffer&>::type operator<<(T value)
+    {
+        char digits[24];
+        char* end = digits + sizeof(digits);
+        char* begin = end;
+
+        bool negative = value < 0;
+        unsigned long long magnitude = negative ? 0ull - static_cast<unsigned long long>(value)
+                                                : static_cast<unsigned long long>(value);
+        do
+        {
+            *--begin = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude);
+
+        if (negative)
+            *--begin = '-';
+        return append(begin, static_cast<size_t>(end - begin));
+    }
+
+    // Escape codes are written directly instead of built with ansi()
+    inline out_buffer& operator<<(std::initializer_list<colors> codes)
+    {
+        *this << "\033[";
+        for (const colors* ptr = codes.begin(); ptr < codes.end(); ptr++)
+        {
+            if (ptr != codes.begin())
+                *this << ';';
+            *this << static_cast<int>(*ptr);
+        }
+        return *this << 'm';
+    }
+
+    inline out_buffer& operator<<(colors code)
+    {
+        return *this << std::initializer_list<colors>{code};
+    }
+
+    // Append a floating point value with a fixed number of decimal places
+    inline out_buffer& fixed(double value, int precision)
+    {
+        char digits[64];
+        int len = std::snprintf(digits, sizeof(digits), "%.*f", precision, value);
+        if (len > 0)
+            append(digits, std::min(static_cast<size_t>(len), sizeof(digits) - 1));
+        return *this;
+    }
+
+    // Append a run of spaces
+    inline out_buffer& pad(size_t count)
+    {
+        static const char spaces[] = "                                ";
+        while (count)
+        {
+            size_t chunk = std::min(count, sizeof(spaces) - 1);
+            append(spaces, chunk);
+            count -= chunk;
+        }
+        return *this;
+    }
+
+    // Write out everything buffered so far. For stdout, anything a test printed
+    // through iostreams or stdio is flushed first so it is not left behind.
+    inline void flush()
+    {
+        if (target == stdout_target())
+        {
+            std::cout.flush();
+            std::fflush(stdout);
+        }
+        if (size)
+        {
+            write_out(data.get(), size);
+            size = 0;
+        }
+        last_flush_ns = wall_now_ns();
+    }
+
+    // Flush where a reader expects to see progress: always when stdout is a
+    // terminal, otherwise only once the current batch has gone stale
+    inline void sync()
+    {
+        if (interactive || wall_now_ns() - last_flush_ns > stale_ns)
+            flush();
+    }
+
+    inline bool is_interactive() const
+    {
+        return interactive;
+    }
+
+private:
+    inline out_buffer(target_type target, bool owns_target)
+        : data(new char[capacity])
+        , target(target)
+        , owns_target(owns_target)
+    {
+#if CCUT_POSIX
+        interactive = ::isatty(target) != 0;
+#endif
+    }
+
+    static inline target_type stdout_target()
+    {
+#if CCUT_POSIX
+        return STDOUT_FILENO;
+#else
+        return stdout;
+#endif
+    }
+
+    inline void write_out(const char* str, size_t len)
+    {
+#if CCUT_POSIX
+        write_all(target, str, len);
+#else
+        std::fwrite(str, 1, len, target);
+        std::fflush(target);
+#endif
+    }
+
+    std::unique_ptr<char[]> data;
+    size_t size = 0;
+    target_type target;
+    bool owns_target;
+    uint64_t last_flush_ns = 0;
+    bool interactive = false;
+};
+
+// The calling thread's report buffer
+static inline out_buffer& out()
+{
+    thread_local out_buffer buffer;
+    return buffer;
+}
+
+//           //
+// Execution //
+//           //
+
+// How a single test ended
+enum class test_status
+{
+    pass,
+    fail,
+    exception,
+    unknown,
+    crash,   // The test's process died; only seen when tests run in child processes
+    timeout, // The test ran past its time limit
+    skipped, // The test never finished because the run was stopped early
+};
+
+// Outcome of a single test
+struct test_result
+{
+    test_status status = test_status::pass;
+    std::string reason;
+    int line = 0;         // Line of the failed assertion, if there was one
+    uint64_t wall_ns = 0; // Time spent in the test body
+    uint64_t cpu_ns = 0;  // CPU time used by the test body's thread
+    uint64_t allocs = 0;      // Heap allocations by the test body's thread, if tracked
+    uint64_t alloc_bytes = 0; // Bytes those allocations asked for
+    counter_values counters = {}; // Counts of each of hw_events(), if any
+};
+
+// Fail a result with the first failure a test recorded on any thread, if it
+// recorded any
+static inline void take_failures(failure_slot& slot, test_context& context, test_result& result)
+{
+    take_thread_failures(context, slot);
+    if (!slot.failed)
+        return;
+    result.status = test_status::fail;
+    result.reason = std::move(slot.reason);
+    result.line = slot.line;
+    if (slot.count > 1)
+        result.reason += " (and " + std::to_string(slot.count - 1) + (slot.count > 2 ? " more failures)" : " more failure)");
+}
+
+#if !CCUT_NO_EXCEPTIONS
+// Give a result whatever its test threw. Only called from a catch block.
+static inline void take_exception(failure_slot& slot, test_context& context, test_result& result)
+{
+    try
+    {
+        throw;
+    }
+    catch (const ccut_exception& ce)
+    {
+        // Any EXPECT_* failure before the throw came first
+        record_failure(slot, ce.get_reason(), ce.get_line());
+        take_failures(slot, context, result);
+        return;
+    }
+    catch (const std::exception& e)
+    {
+        result.status = test_status::exception;
+        result.reason = std::string("Unexpected std::exception: \"") + e.what() + '"';
+    }
+    catch (...)
+    {
+        result.status = test_status::unknown;
+        result.reason = "Totally unknown error was thrown!";
+    }
+
+    // Other threads' failures are outranked, but must not be left for the
+    // next test to take as strays
+    failure_slot ignored;
+    take_thread_failures(context, ignored);
+}
+#endif
+
+// Run one test, converting anything it throws or records into a result. Only
+// the test body is timed; the clocks are read before any reporting work happens.
+static inline void run_test(test_func_t func, test_result& result)
+{
+    failure_slot& slot = current_failure();
+    slot = failure_slot();
+    test_context context;
+    bind_thread binding(&context, true, true);
+
+    alloc_counters& allocs = thread_allocs();
+    allocs.count = 0;
+    allocs.bytes = 0;
+    counter_group& counters = thread_counters();
+
+    uint64_t cpu_start = cpu_now_ns();
+    uint64_t wall_start = wall_now_ns();
+    allocs.armed = true;
+    counters.start();
+    auto stop_clocks = [&]() {
+        counters.stop(result.counters);
+        allocs.armed = false;
+        result.wall_ns = wall_now_ns() - wall_start;
+        result.cpu_ns = cpu_now_ns() - cpu_start;
+        result.allocs = allocs.count;
+        result.alloc_bytes = allocs.bytes;
+    };
+
+#if CCUT_NO_EXCEPTIONS
+    func();
+    stop_clocks();
+    result.status = test_status::pass;
+    take_failures(slot, context, result);
+#else
+    try
+    {
+        func();
+        stop_clocks();
+        result.status = test_status::pass;
+        take_failures(slot, context, result);
+    }
+    catch (...)
+    {
+        stop_clocks();
+        take_exception(slot, context, result);
+    }
+#endif
+}
+
+// Runs task indices on a fixed set of worker threads. Each worker takes tasks
+// from the front of its own deque and, once that is empty, steals from the
+// back of the other workers' deques. No tasks are added while running, so a
+// worker that finds every deque empty is done.
+class work_stealing_pool
+{
+public:
+    inline explicit work_stealing_pool(unsigned workers)
+        : queues(workers)
+    {}
+
+    // Queue a task on a specific worker
+    inline void push(unsigned worker, size_t task)
+    {
+        queues[worker].tasks.push_back(task);
+    }
+
+    // Run all queued tasks as func(worker, task), returning once they are done
+    template <typename Func>
+    inline void run(Func func)
+    {
+        std::vector<std::thread> threads;
+        for (unsigned worker = 0; worker < queues.size(); worker++)
+        {
+            threads.emplace_back([this, worker, &func]() {
+                size_t task;
+                while (pop(worker, task) || steal(worker, task))
+                {
+                    func(worker, task);
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+private:
+    struct queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    inline bool pop(unsigned worker, size_t& task)
+    {
+        queue& own = queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.tasks.empty())
+            return false;
+        task = own.tasks.front();
+        own.tasks.pop_front();
+        return true;
+    }
+
+    inline bool steal(unsigned worker, size_t& task)
+    {
+        for (size_t offset = 1; offset < queues.size(); offset++)
+        {
+            queue& victim = queues[(worker + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<queue> queues;
+};
+
+#if CCUT_HAS_COROUTINES
+
+//             //
+// Async Tests //
+//             //
+
+class async_loop;
+
+// One async test while it runs
+struct async_test
+{
+    async_loop* loop = nullptr;
+    size_t index = 0;             // Index in the batch, when the runner runs it
+    std::coroutine_handle<> root; // The test's outermost coroutine
+    failure_slot failure;         // Its failures, in place of the thread's while it runs
+    test_context context;         // Shared with threads it starts, bound while it runs
+    test_result result;
+    uint64_t started_ns = 0;
+    bool finished = false;
+#if !CCUT_NO_EXCEPTIONS
+    std::exception_ptr error; // What the test threw, if anything
+#endif
+};
+
+// The async test the calling thread is running code of, if any
+inline async_test*& current_async()
+{
+    static thread_local async_test* test = nullptr;
+    return test;
+}
+
+static inline async_test& running_async()
+{
+    async_test* test = current_async();
+    assert(test && "ccut awaitables can only be used inside an async test");
+    return *test;
+}
+
+// Runs async tests on one thread, interleaving them: each runs until it
+// waits for something, and is resumed from a queue once that happens.
+// Resumption can be asked for from any thread, but the tests' code only ever
+// runs on the loop's.
+class async_loop
+{
+public:
+    static constexpr size_t none = static_cast<size_t>(-1);
+
+    // Called on the loop's thread as each test ends
+    std::function<void(async_test&)> on_finished;
+
+    // Called as the loop starts and stops running a test's code
+    std::function<void(const async_test&, bool running)> on_slice;
+
+    // Whether the loop has its thread to itself, as when the runner gives it
+    // many tests. Each test's failures, CPU time and allocations are then kept
+    // apart as the loop switches between them; otherwise they are left to the
+    // thread's running test, as when one async test runs inside run_test().
+    bool isolate = false;
+
+    // Start a test, to be run once the loop runs
+    inline void add(async_test& test, async_start_t start)
+    {
+        start(test);
+        test.loop = this;
+        test.started_ns = wall_now_ns();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        tests.push_back(&test);
+        ready.push_back({&test, test.root});
+        live++;
+    }
+
+    // Resume a test's coroutine as soon as possible, or with a null handle,
+    // finish a test whose outermost coroutine has ended
+    inline void post(async_test* test, std::coroutine_handle<> handle)
+    {
+        untracked_allocs untracked;
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back({test, handle});
+        wake.notify_one();
+    }
+
+    // Resume a test's coroutine once the wall clock reaches the given time
+    inline void post_at(uint64_t when_ns, async_test* test, std::coroutine_handle<> handle)
+    {
+        untracked_allocs untracked;
+        std::lock_guard<std::mutex> lock(mutex);
+        timers.push_back({when_ns, next_timer++, {test, handle}});
+        std::push_heap(timers.begin(), timers.end(), later);
+        wake.notify_one();
+    }
+
+    // Run until every test added has finished
+    inline void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (live)
+        {
+            uint64_t now = wall_now_ns();
+            while (!timers.empty() && timers.front().when_ns <= now)
+            {
+                std::pop_heap(timers.begin(), timers.end(), later);
+                ready.push_back(timers.back().wake);
+                timers.pop_back();
+            }
+
+            if (ready.empty())
+            {
+                if (timers.empty())
+                    wake.wait(lock);
+                else
+                    wake.wait_for(lock, std::chrono::nanoseconds(timers.front().when_ns - now));
+                continue;
+            }
+
+            // Anything made ready by this round waits for the next one
+            running.swap(ready);
+            lock.unlock();
+            for (const entry& next : running)
+            {
+                if (next.handle)
+                    resume(*next.test, next.handle);
+                else
+                    finish(*next.test);
+            }
+            running.clear();
+            lock.lock();
+        }
+    }
+
+    // Find a test that has been running longer than its limit, as watchdog
+    // does for threads, or return none. Safe to call from any thread.
+    inline size_t check(const std::vector<uint64_t>& timeouts, uint64_t now, uint64_t& ran_ns)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const async_test* test : tests)
+        {
+            uint64_t limit = timeouts[test->index];
+            if (!test->finished && limit && now - test->started_ns > limit)
+            {
+                ran_ns = now - test->started_ns;
+                return test->index;
+            }
+        }
+        return none;
+    }
+
+private:
+    struct entry
+    {
+        async_test* test;
+        std::coroutine_handle<> handle; // Null to finish the test
+    };
+
+    struct timer
+    {
+        uint64_t when_ns;
+        uint64_t sequence; // Timers due at the same time fire in the order they were set
+        entry wake;
+    };
+
+    static inline bool later(const timer& a, const timer& b)
+    {
+        return a.when_ns > b.when_ns || (a.when_ns == b.when_ns && a.sequence > b.sequence);
+    }
+
+    inline void resume(async_test& test, std::coroutine_handle<> handle)
+    {
+        async_test*& current = current_async();
+        current = &test;
+        if (!isolate)
+        {
+            handle.resume();
+            current = nullptr;
+            return;
+        }
+
+        failure_slot& slot = current_failure();
+        std::swap(slot, test.failure);
+        bind_thread binding(&test.context, true, true);
+        alloc_counters& allocs = thread_allocs();
+        allocs.count = 0;
+        allocs.bytes = 0;
+        if (on_slice)
+            on_slice(test, true);
+
+        uint64_t cpu_start = cpu_now_ns();
+        allocs.armed = true;
+        handle.resume();
+        allocs.armed = false;
+        test.result.cpu_ns += cpu_now_ns() - cpu_start;
+        test.result.allocs += allocs.count;
+        test.result.alloc_bytes += allocs.bytes;
+
+        if (on_slice)
+            on_slice(test, false);
+        std::swap(slot, test.failure);
+        current = nullptr;
+    }
+
+    inline void finish(async_test& test)
+    {
+        test.result.wall_ns = wall_now_ns() - test.started_ns;
+        test.root.destroy();
+        test.root = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            test.finished = true;
+            live--;
+        }
+        if (on_finished)
+            on_finished(test);
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<entry> ready;
+    std::deque<entry> running; // Only touched by the loop's thread
+    std::vector<timer> timers; // A heap, soonest first
+    std::vector<async_test*> tests;
+    uint64_t next_timer = 0;
+    size_t live = 0;
+};
+
+// What the promise of every ccut coroutine has: the coroutine to carry on
+// with once it ends, and what it threw
+struct task_promise_base
+{
+    struct final_awaiter
+    {
+        inline bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        // Carry on with the awaiting coroutine, or if this is a test's
+        // outermost one, tell the test's loop it has ended. The loop may
+        // destroy the frame as soon as it hears, so nothing touches it after.
+        template <typename Promise>
+        inline std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            task_promise_base& promise = handle.promise();
+            if (promise.continuation)
+                return promise.continuation;
+            if (async_test* test = promise.owner)
+            {
+#if !CCUT_NO_EXCEPTIONS
+                test->error = promise.error;
+#endif
+                test->loop->post(test, nullptr);
+            }
+            return std::noop_coroutine();
+        }
+
+        inline void await_resume() const noexcept
+        {}
+    };
+
+    inline std::suspend_always initial_suspend() const noexcept
+    {
+        return {};
+    }
+
+    inline final_awaiter final_suspend() const noexcept
+    {
+        return {};
+    }
+
+    inline void unhandled_exception() noexcept
+    {
+#if !CCUT_NO_EXCEPTIONS
+        error = std::current_exception();
+#else
+        std::abort();
+#endif
+    }
+
+    std::coroutine_handle<> continuation;
+    async_test* owner = nullptr; // Set for a test's outermost coroutine only
+#if !CCUT_NO_EXCEPTIONS
+    std::exception_ptr error;
+#endif
+};
+
+template <typename T>
+struct task_promise : task_promise_base
+{
+    template <typename U>
+    inline void return_value(U&& result)
+    {
+        value.emplace(std::forward<U>(result));
+    }
+
+    std::optional<T> value;
+};
+
+template <>
+struct task_promise<void> : task_promise_base
+{
+    inline void return_void() const noexcept
+    {}
+};
+
+// The coroutine type of async tests and of the coroutines they await. A task
+// starts suspended, and runs when awaited, resuming its awaiter once it has
+// returned a value or thrown.
+template <typename T = void>
+class [[nodiscard]] task
+{
+public:
+    struct promise_type : task_promise<T>
+    {
+        inline task get_return_object() noexcept
+        {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    inline task(task&& other) noexcept
+        : frame(std::exchange(other.frame, nullptr))
+    {}
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    inline ~task()
+    {
+        if (frame)
+            frame.destroy();
+    }
+
+    inline bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    inline std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        frame.promise().continuation = awaiting;
+        return frame;
+    }
+
+    inline T await_resume()
+    {
+#if !CCUT_NO_EXCEPTIONS
+        if (frame.promise().error)
+            std::rethrow_exception(frame.promise().error);
+#endif
+        if constexpr (!std::is_void<T>::value)
+            return std::move(*frame.promise().value);
+    }
+
+    // Give up ownership of the coroutine's frame
+    inline std::coroutine_handle<promise_type> release() noexcept
+    {
+        return std::exchange(frame, nullptr);
+    }
+
+private:
+    inline explicit task(std::coroutine_handle<promise_type> frame)
+        : frame(frame)
+    {}
+
+    std::coroutine_handle<promise_type> frame;
+};
+
+// Awaited to let the other async tests run before carrying on
+struct async_yield
+{
+    inline bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    inline void await_suspend(std::coroutine_handle<> handle) const
+    {
+        async_test& test = running_async();
+        test.loop->post(&test, handle);
+    }
+
+    inline void await_resume() const noexcept
+    {}
+};
+
+// Awaited to carry on once a duration has passed, without holding a thread
+struct async_sleep
+{
+    uint64_t ns;
+
+    inline bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    inline void await_suspend(std::coroutine_handle<> handle) const
+    {
+        async_test& test = running_async();
+        test.loop->post_at(wall_now_ns() + ns, &test, handle);
+    }
+
+    inline void await_resume() const noexcept
+    {}
+};
+
+// Resumes a suspended async test from any thread, by handing it back to the
+// test's loop. Call it exactly once.
+class resumer
+{
+public:
+    inline resumer(async_test& test, std::coroutine_handle<> handle)
+        : test(&test)
+        , handle(handle)
+    {}
+
+    inline void operator()() const
+    {
+        test->loop->post(test, handle);
+    }
+
+private:
+    async_test* test;
+    std::coroutine_handle<> handle;
+};
+
+// Awaited to suspend until the resumer given to a function is called
+template <typename Start>
+struct async_suspend
+{
+    Start start;
+
+    inline bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    inline void await_suspend(std::coroutine_handle<> handle)
+    {
+        start(resumer(running_async(), handle));
+    }
+
+    inline void await_resume() const noexcept
+    {}
+};
+
+// Let the other async tests run, as in co_await ccut_framework::yield()
+static inline async_yield yield()
+{
+    return {};
+}
+
+// Wait without holding a thread, as in co_await ccut_framework::sleep_for(10ms)
+template <typename Rep, typename Period>
+static inline async_sleep sleep_for(std::chrono::duration<Rep, Period> duration)
+{
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    return {ns > 0 ? static_cast<uint64_t>(ns) : 0};
+}
+
+// Suspend until something calls back, for waiting on callback-based APIs:
+//
+//     co_await ccut_framework::suspend([&](ccut_framework::resumer resume) {
+//         socket.async_read(buffer, [resume](size_t) { resume(); });
+//     });
+template <typename Start>
+static inline async_suspend<Start> suspend(Start start)
+{
+    return {std::move(start)};
+}
+
+// Hand an async test's body over to the test
+static inline void start_async(task<> body, async_test& test)
+{
+    std::coroutine_handle<task<>::promise_type> frame = body.release();
+    frame.promise().owner = &test;
+    test.root = frame;
+}
+
+// Run an async test to completion on the calling thread, on a loop of its
+// own. This is how an async test runs inside run_test(), when the runner
+// can't interleave it with others: in --fork children, in the serial lane,
+// and in runners built without coroutines.
+static inline void run_async_inline(async_start_t start)
+{
+    async_test test;
+    async_loop loop;
+    loop.add(test, start);
+    loop.run();
+#if !CCUT_NO_EXCEPTIONS
+    if (test.error)
+        std::rethrow_exception(test.error);
+#endif
+}
+
+// Turn what an async test that ended on an isolating loop recorded or threw
+// into its result
+static inline void take_async_result(async_test& test)
+{
+    test.result.status = test_status::pass;
+#if !CCUT_NO_EXCEPTIONS
+    if (test.error)
+    {
+        try
+        {
+            std::rethrow_exception(test.error);
+        }
+        catch (...)
+        {
+            take_exception(test.failure, test.context, test.result);
+        }
+        return;
+    }
+#endif
+    take_failures(test.failure, test.context, test.result);
+}
+
+#endif // CCUT_HAS_COROUTINES
+
+//         //
+// Options //
+//         //
+
+// Runner configuration, read from the environment and then the command line
+struct options
+{
+    unsigned jobs = 1;                  // Worker threads; 1 runs everything on the main thread
+    unsigned shards = 0;                // Child processes to isolate tests in; 0 runs in-process
+    uint64_t slow_threshold_ns = 0;     // Flag tests slower than this; 0 disables
+    uint64_t timeout_ns = 0;            // Limit on each test's run time; 0 disables
+    unsigned slowest = 5;               // How many of the slowest tests to list
+    unsigned repeat = 1;                // Passes over the selected tests; 0 repeats until a failure
+    bool until_fail = false;            // Stop repeating after the first failure
+    bool shuffle = false;               // Run tests in a random order
+    uint64_t seed = 0;                  // Seed for the shuffled order, random unless given
+    std::string baseline;               // File of timings to compare against, written if missing
+    double baseline_tolerance = 20;     // Percent slower than the baseline that still passes
+    bool update_baseline = false;       // Rewrite the baseline after a passing run
+    bool update_golden = false;         // Rewrite golden files that don't match instead of failing
+    std::vector<hw_event> counters;     // Hardware events to count around each test
+    std::string result_cache;           // File remembering each test's last result; empty for none
+    bool rerun_failed = false;          // Run only tests that failed, changed or never ran last time
+    unsigned node = 0;                  // Which share of the tests to run, counting from 0...
+    unsigned nodes = 1;                 // ...of this many, split between machines by --shard=i/N
+    bool bench = false;                 // Run benchmarks after the tests
+    uint64_t bench_time_ns = 500000000; // Target measuring time per benchmark
+    unsigned bench_samples = 10;        // Timed batches per benchmark
+    uint64_t bench_warmup_ns = 0;       // Untimed running of each benchmark before it is measured
+    int bench_cpu = -1;                 // CPU to pin benchmarks to; -1 leaves them unpinned
+    std::string bench_out;              // File for every benchmark's samples; empty for none
+    std::string bench_compare_old;      // Sample files to compare instead of running anything,
+    std::string bench_compare_new;      // given by --bench-compare=old,new
+    bool stdio_sync = true;             // Keep iostreams synchronized with C stdio
+    std::string reporter = "human";     // human, junit, jsonl or tap
+    std::string output;                 // File for the report instead of stdout
+
+    // Test selection; see select_tests()
+    bool list = false; // Print the names of the selected tests instead of running them
+    std::vector<std::string> filters;
+    std::vector<std::string> excludes;
+    std::vector<std::string> tags;
+    std::vector<std::string> exclude_tags;
+};
+
+// Parse a job or shard count, where 0 means one per hardware thread
+static inline bool parse_count(const char* str, unsigned& count)
+{
+    char* end = nullptr;
+    unsigned long value = std::strtoul(str, &end, 10);
+    if (!*str || *end || value > 4096)
+        return false;
+
+    count = static_cast<unsigned>(value);
+    if (count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+    return true;
+}
+
+// Parse a duration such as "250ms" or "1.5s" into nanoseconds. Bare numbers
+// are seconds.
+static inline bool parse_duration(const char* str, uint64_t& ns)
+{
+    char* end = nullptr;
+    double value = std::strtod(str, &end);
+    if (end == str || !(value >= 0))
+        return false;
+
+    double scale;
+    if (!*end || std::strcmp(end, "s") == 0)
+        scale = 1e9;
+    else if (std::strcmp(end, "ms") == 0)
+        scale = 1e6;
+    else if (std::strcmp(end, "us") == 0)
+        scale = 1e3;
+    else if (std::strcmp(end, "ns") == 0)
+        scale = 1;
+    else if (std::strcmp(end, "m") == 0 || std::strcmp(end, "min") == 0)
+        scale = 60e9;
+    else
+        return false;
+
+    ns = static_cast<uint64_t>(value * scale);
+    return true;
+}
+
+// Parse a comma-separated list of event names such as "cycles,instructions"
+static inline bool parse_counters(const char* str, std::vector<hw_event>& events)
+{
+    events.clear();
+    for (const char* pos = str;; pos++)
+    {
+        const char* end = std::strchr(pos, ',');
+        size_t len = end ? static_cast<size_t>(end - pos) : std::strlen(pos);
+
+        size_t found = 0;
+        while (found < std::size(hw_event_names)
+               && (std::strlen(hw_event_names[found]) != len || std::strncmp(hw_event_names[found], pos, len)))
+        {
+            found++;
+        }
+        if (found == std::size(hw_event_names))
+            return false;
+
+        hw_event event = static_cast<hw_event>(found);
+        if (std::find(events.begin(), events.end(), event) == events.end())
+            events.push_back(event);
+
+        if (!end)
+            return true;
+        pos = end;
+    }
+}
+
+// Match "--name=value" or "--name value", advancing past a separate value
+static inline bool match_option(const char* name, int argc, char** argv, int& i, const char*& value)
+{
+    size_t len = std::strlen(name);
+    if (std::strncmp(argv[i], name, len) != 0)
+        return false;
+
+    if (argv[i][len] == '=')
+    {
+        value = argv[i] + len + 1;
+        return true;
+    }
+    if (argv[i][len] == '\0')
+    {
+        value = i + 1 < argc ? argv[++i] : nullptr;
+        return true;
+    }
+    return false;
+}
+
+// Fill in options, returning false and printing why on bad input
+static inline bool parse_options(int argc, char** argv, options& opts)
+{
+    if (const char* env = std::getenv("CCUT_JOBS"))
+    {
+        if (!parse_count(env, opts.jobs))
+        {
+            std::cerr << "Invalid CCUT_JOBS value: \"" << env << "\"\n";
+            return false;
+        }
+    }
+
+    // Filters and tags may be given more than once
+    auto add_pattern = [](const char* arg, const char* value, std::vector<std::string>& patterns) {
+        if (!value || !*value)
+        {
+            std::cerr << "Missing pattern for " << arg << "\n";
+            return false;
+        }
+        patterns.push_back(value);
+        return true;
+    };
+
+    bool fork_requested = false;
+    bool repeat_given = false;
+    bool seed_given = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = nullptr;
+
+        if (match_option("--jobs", argc, argv, i, value) || match_option("-j", argc, argv, i, value))
+        {
+            if (!value || !parse_count(value, opts.jobs))
+            {
+                std::cerr << "Invalid job count for " << arg << "\n";
+                return false;
+            }
+        }
+        else if (match_option("--slow-threshold", argc, argv, i, value))
+        {
+            if (!value || !parse_duration(value, opts.slow_threshold_ns))
+            {
+                std::cerr << "Invalid duration for " << arg << "\n";
+                return false;
+            }
+        }
+        else if (match_option("--timeout", argc, argv, i, value))
+        {
+            if (!value || !parse_duration(value, opts.timeout_ns))
+            {
+                std::cerr << "Invalid duration for " << arg << "\n";
+                return false;
+            }
+        }
+        else if (match_option("--slowest", argc, argv, i, value))
+        {
+            char* end = nullptr;
+            unsigned long count = value ? std::strtoul(value, &end, 10) : 0;
+            if (!value || !*value || *end)
+            {
+                std::cerr << "Invalid count for " << arg << "\n";
+                return false;
+            }
+            opts.slowest = static_cast<unsigned>(count);
+        }
+        else if (match_option("--repeat", argc, argv, i, value))
+        {
+            char* end = nullptr;
+            unsigned long count = value ? std::strtoul(value, &end, 10) : 0;
+            if (!value || !*value || *end || count == 0)
+            {
+                std::cerr << "Invalid count for " << arg << "\n";
+                return false;
+            }
+            opts.repeat = static_cast<unsigned>(count);
+            repeat_given = true;
+        }
+        else if (std::strcmp(arg, "--until-fail") == 0)
+        {
+            opts.until_fail = true;
+        }
+        else if (std::strcmp(arg, "--shuffle") == 0)
+        {
+            opts.shuffle = true;
+        }
+        else if (match_option("--seed", argc, argv, i, value))
+        {
+            char* end = nullptr;
+            opts.seed = value ? std::strtoull(value, &end, 10) : 0;
+            if (!value || !*value || *end)
+            {
+                std::cerr << "Invalid seed for " << arg << "\n";
+                return false;
+            }
+            seed_given = true;
+            opts.shuffle = true;
+        }
+        else if (match_option("--baseline", argc, argv, i, value))
+        {
+            if (!value || !*value)
+            {
+                std::cerr << "Missing path for " << arg << "\n";
+                return false;
+            }
+            opts.baseline = value;
+        }
+        else if (match_option("--baseline-tolerance", argc, argv, i, value))
+        {
+            char* end = nullptr;
+            opts.baseline_tolerance = value ? std::strtod(value, &end) : -1;
+            if (end && *end == '%')
+                end++;
+            if (!value || end == value || *end || !(opts.baseline_tolerance >= 0))
+            {
+                std::cerr << "Invalid percentage for " << arg << "\n";
+                return false;
+            }
+        }
+        else if (std::strcmp(arg, "--update-baseline") == 0)
+        {
+            opts.update_baseline = true;
+        }
+        else if (std::strcmp(arg, "--update-golden") == 0)
+        {
+            opts.update_golden = true;
+        }
+        else if (match_option("--counters", argc, argv, i, value))
+        {
+            if (!value || !parse_counters(value, opts.counters))
+            {
+                std::cerr << "Invalid event list for " << arg << "; expected some of cycles, instructions, "
+                          << "cache-references, cache-misses, branches and branch-misses\n";
+                return false;
+            }
+        }
+        else if (match_option("--result-cache", argc, argv, i, value))
+        {
+            if (!value || !*value)
+            {
+                std::cerr << "Missing path for " << arg << "\n";
+                return false;
+            }
+            opts.result_cache = value;
+        }
+        else if (match_option("--shard", argc, argv, i, value))
+        {
+            char* end = nullptr;
+            unsigned long node = value ? std::strtoul(value, &end, 10) : 0;
+            unsigned long nodes = 0;
+            if (value && end != value && *end == '/')
+            {
+                const char* count = end + 1;
+                nodes = std::strtoul(count, &end, 10);
+                if (end == count || *end)
+                    nodes = 0;
+            }
+            if (!nodes || nodes > 65536 || node >= nodes)
+            {
+                std::cerr << "Invalid shard for " << arg << "; expected i/N with 0 <= i < N\n";
+                return false;
+            }
+            opts.node = static_cast<unsigned>(node);
+            opts.nodes = static_cast<unsigned>(nodes);
+        }
+        else if (std::strcmp(arg, "--rerun-failed") == 0)
+        {
+            opts.rerun_failed = true;
+        }
+        else if (std::strcmp(arg, "--list") == 0)
+        {
+            opts.list = true;
+        }
+        else if (match_option("--filter", argc, argv, i, value))
+        {
+            if (!add_pattern(arg, value, opts.filters))
+                return false;
+        }
+        else if (match_option("--exclude", argc, argv, i, value))
+        {
+            if (!add_pattern(arg, value, opts.excludes))
+                return false;
+        }
+        else if (match_option("--tag", argc, argv, i, value))
+        {
+            if (!add_pattern(arg, value, opts.tags))
+                return false;
+        }
+        else if (match_option("--exclude-tag", argc, argv, i, value))
+        {
+            if (!add_pattern(arg, value, opts.exclude_tags))
+                return false;
+        }
+        else if (match_option("--reporter", argc, argv, i, value))
+        {
+            if (!value || (std::strcmp(value, "human") && std::strcmp(value, "junit") && std::strcmp(value, "jsonl")
+                           && std::strcmp(value, "tap")))
+            {
+                std::cerr << "Unknown reporter for " << arg << "; expected human, junit, jsonl or tap\n";
+                return false;
+            }
+            opts.reporter = value;
+        }
+        else if (match_option("--output", argc, argv, i, value))
+        {
+            if (!value || !*value)
+            {
+                std::cerr << "Missing path for " << arg << "\n";
+                return false;
+            }
+            opts.output = value;
+        }
+        else if (std::strcmp(arg, "--no-stdio-sync") == 0)
+        {
+            opts.stdio_sync = false;
+        }
+        else if (std::strcmp(arg, "--bench") == 0)
+        {
+            opts.bench = true;
+        }
+        else if (match_option("--bench-time", argc, argv, i, value))
+        {
+            if (!value || !parse_duration(value, opts.bench_time_ns) || !opts.bench_time_ns)
+            {
+                std::cerr << "Invalid duration for " << arg << "\n";
+                return false;
+            }
+        }
+        else if (match_option("--bench-samples", argc, argv, i, value))
+        {
+            char* end = nullptr;
+            unsigned long count = value ? std::strtoul(value, &end, 10) : 0;
+            if (!value || !*value || *end || count == 0)
+            {
+                std::cerr << "Invalid count for " << arg << "\n";
+                return false;
+            }
+            opts.bench_samples = static_cast<unsigned>(count);
+        }
+        else if (match_option("--bench-warmup", argc, argv, i, value))
+        {
+            if (!value || !parse_duration(value, opts.bench_warmup_ns))
+            {
+                std::cerr << "Invalid duration for " << arg << "\n";
+                return false;
+            }
+        }
+        else if (match_option("--bench-cpu", argc, argv, i, value))
+        {
+#if defined(__linux__)
+            char* end = nullptr;
+            unsigned long cpu = value ? std::strtoul(value, &end, 10) : 0;
+            if (!value || !*value || *end || cpu >= CPU_SETSIZE)
+            {
+                std::cerr << "Invalid CPU for " << arg << "\n";
+                return false;
+            }
+            opts.bench_cpu = static_cast<int>(cpu);
+#else
+            std::cerr << arg << " is not supported on this platform\n";
+            return false;
+#endif
+        }
+        else if (match_option("--bench-out", argc, argv, i, value))
+        {
+            if (!value || !*value)
+            {
+                std::cerr << "Missing path for " << arg << "\n";
+                return false;
+            }
+            opts.bench_out = value;
+            opts.bench = true;
+        }
+        else if (match_option("--bench-compare", argc, argv, i, value))
+        {
+            const char* comma = value ? std::strchr(value, ',') : nullptr;
+            if (!comma || comma == value || !comma[1])
+            {
+                std::cerr << "Invalid files for " << arg << "; expected old,new\n";
+                return false;
+            }
+            opts.bench_compare_old.assign(value, comma);
+            opts.bench_compare_new = comma + 1;
+        }
+        else if (std::strcmp(arg, "--fork") == 0)
+        {
+            fork_requested = true;
+        }
+        else if (std::strncmp(arg, "--fork=", 7) == 0)
+        {
+            fork_requested = true;
+            if (!parse_count(arg + 7, opts.shards))
+            {
+                std::cerr << "Invalid shard count for " << arg << "\n";
+                return false;
+            }
+        }
+        else if (std::strncmp(arg, "-j", 2) == 0)
+        {
+            if (!parse_count(arg + 2, opts.jobs))
+            {
+                std::cerr << "Invalid job count for " << arg << "\n";
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown option: \"" << arg << "\"\n";
+            return false;
+        }
+    }
+
+    // A bare --fork gives each job its own shard process
+    if (fork_requested && !opts.shards)
+        opts.shards = opts.jobs;
+
+    // --until-fail keeps going indefinitely unless given a --repeat limit
+    if (opts.until_fail && !repeat_given)
+        opts.repeat = 0;
+
+    if (opts.update_baseline && opts.baseline.empty())
+    {
+        std::cerr << "--update-baseline needs --baseline\n";
+        return false;
+    }
+
+    // Rerunning failures needs somewhere to remember them, by default next to
+    // the test binary
+    if (opts.rerun_failed && opts.result_cache.empty())
+    {
+        if (argc < 1 || !argv[0] || !*argv[0])
+        {
+            std::cerr << "--rerun-failed needs --result-cache\n";
+            return false;
+        }
+        opts.result_cache = std::string(argv[0]) + ".results";
+    }
+
+    if (opts.shuffle && !seed_given)
+        opts.seed = (static_cast<uint64_t>(std::random_device()()) << 32) ^ wall_now_ns();
+
+#if !CCUT_HAS_FORK
+    if (opts.shards)
+    {
+        std::cerr << "--fork is not supported on this platform\n";
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+//           //
+// Filtering //
+//           //
+
+// Match a name against a glob, where '*' matches any run of characters and
+// '?' matches any single character
+static inline bool glob_match(const char* glob, const char* name)
+{
+    const char* star = nullptr;
+    const char* resume = nullptr;
+    while (*name)
+    {
+        if (*glob == '*')
+        {
+            star = glob++;
+            resume = name;
+        }
+        else if (*glob == '?' || *glob == *name)
+        {
+            glob++;
+            name++;
+        }
+        else if (star)
+        {
+            glob = star + 1;
+            name = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*glob == '*')
+    {
+        glob++;
+    }
+    return !*glob;
+}
+
+// Order C strings by their contents
+static inline bool name_less(const char* a, const char* b)
+{
+    return std::strcmp(a, b) < 0;
+}
+
+// A run's --filter or --exclude globs, matched against one name at a time.
+// Globs without wildcards are kept sorted for binary search, and the rest are
+// split at their first wildcard so most names are rejected by comparing the
+// literal prefix.
+class name_matcher
+{
+public:
+    inline explicit name_matcher(const std::vector<std::string>& globs)
+    {
+        for (const std::string& glob : globs)
+        {
+            size_t prefix_len = std::strcspn(glob.c_str(), "*?");
+            if (prefix_len == glob.size())
+                exact.push_back(glob.c_str());
+            else
+                wildcards.push_back({glob.c_str(), prefix_len});
+        }
+        std::sort(exact.begin(), exact.end(), name_less);
+    }
+
+    inline bool empty() const
+    {
+        return exact.empty() && wildcards.empty();
+    }
+
+    inline bool matches(const char* name) const
+    {
+        if (!exact.empty() && std::binary_search(exact.begin(), exact.end(), name, name_less))
+            return true;
+        for (const std::pair<const char*, size_t>& glob : wildcards)
+        {
+            if (std::strncmp(name, glob.first, glob.second) == 0 && glob_match(glob.first + glob.second, name + glob.second))
+                return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<const char*> exact;
+    std::vector<std::pair<const char*, size_t>> wildcards; // Each glob and the length of its literal prefix
+};
+
+// Whether a test carries any of the given tags
+static inline bool has_any_tag(const RegisterTest* test, const std::vector<std::string>& tags)
+{
+    for (const char* const* tag = test->tags; tag && *tag; tag++)
+    {
+        for (const std::string& wanted : tags)
+        {
+            if (wanted == *tag)
+                return true;
+        }
+    }
+    return false;
+}
+
+// Pick the tests a run should execute, sorted by name. A test runs if it
+// matches any --filter (or there are none), carries any --tag (or there are
+// none), and matches no --exclude or --exclude-tag. Tests are picked in one
+// pass over the unsorted registry and only the chosen ones are sorted, so a
+// narrow filter stays cheap however many tests are registered.
+static inline std::vector<const RegisterTest*> select_tests(const registry_list<RegisterTest>& registry,
+                                                            const options& opts)
+{
+    name_matcher filters(opts.filters);
+    name_matcher excludes(opts.excludes);
+
+    std::vector<const RegisterTest*> selected;
+    if (filters.empty())
+        selected.reserve(registry.size);
+    for (const RegisterTest* test = registry.head; test; test = test->next)
+    {
+        if ((filters.empty() || filters.matches(test->name)) && (opts.tags.empty() || has_any_tag(test, opts.tags))
+            && !excludes.matches(test->name) && !has_any_tag(test, opts.exclude_tags))
+            selected.push_back(test);
+    }
+    sort_by_name(selected);
+    return selected;
+}
+
+//        //
+// Runner //
+//        //
+
+// Everything known about one run of the registry. Tests run in batches, each
+// reusing the same vectors; within a batch tests are referred to by their
+// index in run order, and results are reported in that order. Without
+// repetition there is one batch holding each selected test once.
+struct run_state
+{
+    std::vector<const RegisterTest*> order;
+    std::vector<test_result> results;
+    std::vector<uint64_t> timeouts; // Each test's time limit in ns, or 0 for none
+    std::vector<uint64_t> expected; // Each test's wall time in earlier runs in ns, or 0 if unknown
+    size_t first = 0;      // Results reported before this batch
+    size_t planned = 0;    // Results the whole run will report, or 0 if not known up front
+    size_t registered = 0; // Tests in the registry, including filtered ones
+    size_t selected = 0;   // Tests chosen to run, counted once however often they repeat
+    size_t max_name_len = 0;
+    size_t passed = 0;     // Results reported so far that passed
+    size_t reported = 0;   // Results reported so far
+    unsigned repetitions = 1; // Passes over the selected tests made so far
+    bool track_allocs = false; // Results carry allocation counts
+    std::vector<hw_event> counters; // Events results carry counts of
+    bool shuffled = false;
+    uint64_t seed = 0;     // Seed of the shuffled order, if shuffled
+    bool until_fail = false; // Stop at the end of the first pass with a failure
+};
+
+// Whether the batch should stop after reporting result index: under
+// --until-fail, once the result ends a pass and the run has had a failure.
+// Passes are runs of selected tests in order, and earlier batches had no
+// failures, so the run's counts tell.
+static inline bool pass_stops_run(const run_state& state, size_t index)
+{
+    return state.until_fail && state.passed != state.reported && (index + 1) % state.selected == 0;
+}
+
+// Work out a test's time limit: a "timeout=<duration>" tag, or else the
+// --timeout default. Returns false if the tag's duration can't be parsed.
+static inline bool test_timeout(const RegisterTest* test, uint64_t fallback_ns, uint64_t& ns)
+{
+    ns = fallback_ns;
+    for (const char* const* tag = test->tags; tag && *tag; tag++)
+    {
+        if (std::strncmp(*tag, "timeout=", 8) == 0 && !parse_duration(*tag + 8, ns))
+            return false;
+    }
+    return true;
+}
+
+//           //
+// Reporters //
+//           //
+
+// Lowercase name of a status, as used by the machine-readable reporters
+static inline const char* status_name(test_status status)
+{
+    switch (status)
+    {
+    case test_status::pass:
+        return "pass";
+    case test_status::fail:
+        return "fail";
+    case test_status::exception:
+        return "exception";
+    case test_status::unknown:
+        return "unknown";
+    case test_status::crash:
+        return "crash";
+    case test_status::timeout:
+        return "timeout";
+    case test_status::skipped:
+        return "skipped";
+    }
+    return "unknown";
+}
+
+// Format a duration with a unit suited to its size
+static inline std::string format_duration(uint64_t ns)
+{
+    std::ostringstream os;
+    os.setf(std::ios::fixed);
+    os.precision(2);
+    if (ns < 1000)
+        os << ns << " ns";
+    else if (ns < 1000000)
+        os << ns / 1e3 << " us";
+    else if (ns < 1000000000)
+        os << ns / 1e6 << " ms";
+    else
+        os << ns / 1e9 << " s";
+    return os.str();
+}
+
+// Format a per-call time, keeping sub-nanosecond precision
+static inline std::string format_op_time(double ns)
+{
+    std::ostringstream os;
+    os.setf(std::ios::fixed);
+    os.precision(2);
+    if (ns < 1e3)
+        os << ns << " ns";
+    else if (ns < 1e6)
+        os << ns / 1e3 << " us";
+    else if (ns < 1e9)
+        os << ns / 1e6 << " ms";
+    else
+        os << ns / 1e9 << " s";
+    return os.str();
+}
+
+// Receives each result as soon as it can be reported, in run order. Results
+// are not kept for reporters, so a reporter that needs them later saves what
+// it needs itself.
+class reporter
+{
+public:
+    inline explicit reporter(out_buffer& buf)
+        : buf(buf)
+    {}
+
+    virtual ~reporter() {}
+
+    virtual void run_starting(const run_state&) {}
+
+    // Called just before a test runs when tests run one at a time, or just
+    // before test_finished() otherwise
+    virtual void test_starting(const run_state&, size_t) {}
+
+    virtual void test_finished(const run_state& state, size_t index) = 0;
+
+    virtual void run_finished(const run_state&, uint64_t) {}
+
+    // Keep a file reporter's buffer alive for as long as the reporter
+    inline void own(std::unique_ptr<out_buffer> file)
+    {
+        owned = std::move(file);
+    }
+
+    out_buffer& buf;
+
+private:
+    std::unique_ptr<out_buffer> owned;
+};
+
+// Failures kept for the end of a run. Messages are stored uncolored, packed
+// one after another into large blocks, so each failure costs its text and a
+// few words whatever the failure count. Each message is cut short at
+// max_detail bytes, and once budget bytes of text are stored only the names
+// and lines of later failures are kept.
+class failure_log
+{
+public:
+    static constexpr size_t max_detail = 4096;
+    static constexpr size_t budget = size_t(64) << 20;
+    static constexpr size_t block_size = size_t(1) << 20;
+
+    struct entry
+    {
+        const char* name;   // The test's registered name
+        const char* reason; // Stored text, or null if the budget was used up
+        uint32_t length;    // Bytes of text stored
+        uint32_t cut;       // Bytes of the message left out
+        int line;
+    };
+
+    inline void add(const char* name, int line, const std::string& reason)
+    {
+        size_t length = std::min(reason.size(), max_detail);
+
+        // Don't split a UTF-8 sequence
+        if (length < reason.size())
+        {
+            while (length > 0 && (static_cast<unsigned char>(reason[length]) & 0xC0) == 0x80)
+                length--;
+        }
+
+        const char* stored = nullptr;
+        if (stored_bytes + length <= budget)
+        {
+            stored = store(reason.data(), length);
+            stored_bytes += length;
+        }
+        else
+        {
+            dropped++;
+            length = 0;
+        }
+        entries.push_back({name, stored, static_cast<uint32_t>(length),
+                           static_cast<uint32_t>(std::min<size_t>(reason.size() - length, UINT32_MAX)), line});
+    }
+
+    inline bool empty() const
+    {
+        return entries.empty();
+    }
+
+    std::vector<entry> entries;
+    size_t dropped = 0; // Failures whose text wasn't kept
+
+private:
+    inline const char* store(const char* text, size_t length)
+    {
+        if (blocks.empty() || block_size - block_used < length)
+        {
+            blocks.emplace_back(new char[block_size]);
+            block_used = 0;
+        }
+        char* copy = blocks.back().get() + block_used;
+        std::memcpy(copy, text, length);
+        block_used += length;
+        return copy;
+    }
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t block_used = 0;
+    size_t stored_bytes = 0;
+};
+
+// The colored, human-readable report
+class human_reporter : public reporter
+{
+public:
+    inline human_reporter(out_buffer& buf, uint64_t slow_threshold_ns, unsigned slowest)
+        : reporter(buf)
+        , slow_threshold_ns(slow_threshold_ns)
+        , slowest(slowest)
+    {}
+
+    inline void run_starting(const run_state& state) override
+    {
+        // The seed is all it takes to run the same order again
+        if (state.shuffled)
+            buf << "Shuffled test order; rerun it with --seed=" << state.seed << "\n\n";
+    }
+
+    inline void test_starting(const run_state& state, size_t index) override
+    {
+        const char* name = state.order[index]->name;
+        size_t spaces = state.max_name_len - std::strlen(name);
+        buf << "Running test \"" << name << "\"";
+        buf.pad(spaces) << " . . . ";
+
+        // Show which test is running on a terminal
+        if (buf.is_interactive())
+            buf.flush();
+    }
+
+    inline void test_finished(const run_state& state, size_t index) override
+    {
+        const test_result& result = state.results[index];
+        print_status(result.status);
+        if (slow_threshold_ns && result.wall_ns > slow_threshold_ns)
+            buf << colors::yellow << " (SLOW: " << format_duration(result.wall_ns) << ")" << colors::none;
+        if (state.track_allocs && result.allocs)
+            buf << " (" << result.allocs << (result.allocs == 1 ? " alloc, " : " allocs, ") << result.alloc_bytes
+                << " bytes)";
+        buf << '\n';
+
+        if (result.status == test_status::skipped)
+            skipped++;
+        else if (result.status != test_status::pass)
+            failures.add(state.order[index]->name, result.line, result.reason);
+
+        // Tests that didn't finish have no timing
+        if (result.status != test_status::crash && result.status != test_status::timeout
+            && result.status != test_status::skipped)
+            timings.push_back({state.order[index]->name, result.wall_ns, result.cpu_ns, result.counters});
+    }
+
+    inline void run_finished(const run_state& state, uint64_t total_ns) override
+    {
+        // Print failure reasons, if any
+        if (!failures.empty())
+        {
+            buf << "\n- - - Failures - - -\n";
+            for (const failure_log::entry& fail : failures.entries)
+            {
+                //            [function name]            why it failed
+                buf << " -> [" << fail.name << "] ";
+                if (fail.line)
+                    buf << "Line " << colors::bold << fail.line << colors::none << ": ";
+                if (fail.reason)
+                    buf.append(fail.reason, fail.length);
+                if (fail.cut)
+                    buf << colors::yellow << (fail.reason ? " ... (" : "(") << fail.cut << " bytes not kept)"
+                        << colors::none;
+                buf << "\n";
+            }
+            if (failures.dropped)
+                buf << failures.dropped << " failure message" << (failures.dropped == 1 ? " was" : "s were")
+                    << " dropped after the first " << (failure_log::budget >> 20) << " MiB\n";
+        }
+
+        print_timing(state, total_ns);
+        buf << "\n";
+
+        // Print overall summary
+        if (state.repetitions > 1)
+            buf << "Repetitions: " << state.repetitions << "\n";
+        buf << "Total passed: [" << state.passed << " / " << state.reported << "]";
+        if (state.selected != state.registered)
+            buf << " (" << state.registered - state.selected << " filtered out)";
+        if (skipped)
+            buf << " (" << skipped << " skipped)";
+        buf << "\n";
+    }
+
+private:
+    struct timing
+    {
+        const char* name;
+        uint64_t wall_ns;
+        uint64_t cpu_ns;
+        counter_values counters;
+    };
+
+    // Print the status word of a test's report line
+    inline void print_status(test_status status)
+    {
+        switch (status)
+        {
+        case test_status::pass:
+            buf << colors::green << "PASS" << colors::none;
+            break;
+        case test_status::fail:
+            buf << colors::red << "FAIL" << colors::none;
+            break;
+        case test_status::exception:
+            buf << colors::yellow << "EXCEPTION" << colors::none;
+            break;
+        case test_status::unknown:
+            buf << std::initializer_list<colors>{colors::red, colors::bold} << "UNRECOGNIZED EXCEPTION" << colors::none;
+            break;
+        case test_status::crash:
+            buf << std::initializer_list<colors>{colors::red, colors::bold} << "CRASH" << colors::none;
+            break;
+        case test_status::timeout:
+            buf << std::initializer_list<colors>{colors::red, colors::bold} << "TIMEOUT" << colors::none;
+            break;
+        case test_status::skipped:
+            buf << colors::yellow << "SKIPPED" << colors::none;
+            break;
+        }
+    }
+
+    // Print total time, the slowest tests and the spread of test durations
+    inline void print_timing(const run_state& state, uint64_t total_ns)
+    {
+        uint64_t wall_sum = 0;
+        uint64_t cpu_sum = 0;
+        size_t slow_count = 0;
+        double counter_sums[max_hw_counters] = {};
+        for (const auto& timing : timings)
+        {
+            wall_sum += timing.wall_ns;
+            cpu_sum += timing.cpu_ns;
+            if (slow_threshold_ns && timing.wall_ns > slow_threshold_ns)
+                slow_count++;
+            for (size_t i = 0; i < state.counters.size(); i++)
+            {
+                counter_sums[i] += static_cast<double>(timing.counters[i]);
+            }
+        }
+
+        buf << "\n- - - Timing - - -\n";
+        buf << "Total time: " << format_duration(total_ns) << " (tests: " << format_duration(wall_sum)
+            << " wall, " << format_duration(cpu_sum) << " CPU)\n";
+        if (!state.counters.empty())
+            buf << "Counters: " << describe_counters(state.counters, counter_sums, "") << "\n";
+        if (timings.empty())
+            return;
+
+        std::sort(timings.begin(), timings.end(), [](const timing& a, const timing& b) {
+            return a.wall_ns > b.wall_ns;
+        });
+
+        // Nearest-rank percentiles over the descending order
+        auto percentile = [&](unsigned p) {
+            size_t rank = (timings.size() * p + 99) / 100;
+            return timings[timings.size() - std::max<size_t>(rank, 1)].wall_ns;
+        };
+        buf << "p50: " << format_duration(percentile(50)) << ", p95: " << format_duration(percentile(95))
+            << ", p99: " << format_duration(percentile(99)) << "\n";
+
+        if (slowest)
+        {
+            buf << "Slowest tests:\n";
+            for (size_t i = 0; i < timings.size() && i < slowest; i++)
+            {
+                buf << " -> [" << timings[i].name << "] " << format_duration(timings[i].wall_ns)
+                    << " wall, " << format_duration(timings[i].cpu_ns) << " CPU";
+                if (!state.counters.empty())
+                {
+                    double counts[max_hw_counters];
+                    std::copy(timings[i].counters.begin(), timings[i].counters.end(), counts);
+                    buf << "; " << describe_counters(state.counters, counts, "");
+                }
+                buf << "\n";
+            }
+        }
+
+        if (slow_threshold_ns)
+        {
+            buf << "Over " << format_duration(slow_threshold_ns) << ": " << slow_count << " test"
+                << (slow_count == 1 ? "" : "s") << "\n";
+        }
+    }
+
+    uint64_t slow_threshold_ns;
+    unsigned slowest;
+    failure_log failures;
+    std::vector<timing> timings; // Of every test that finished
+    size_t skipped = 0;
+};
+
+// Append text escaped for an XML attribute or element
+static inline void append_xml_escaped(out_buffer& buf, const char* str, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        switch (str[i])
+        {
+        case '&': buf << "&amp;"; break;
+        case '<': buf << "&lt;"; break;
+        case '>': buf << "&gt;"; break;
+        case '"': buf << "&quot;"; break;
+        case '\'': buf << "&apos;"; break;
+        default:
+            // Control characters other than whitespace are not allowed in XML 1.0
+            if (static_cast<unsigned char>(str[i]) < 0x20 && str[i] != '\n' && str[i] != '\t' && str[i] != '\r')
+                buf << '?';
+            else
+                buf << str[i];
+        }
+    }
+}
+
+// Append text as the inside of a JSON string
+static inline void append_json_escaped(out_buffer& buf, const char* str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        switch (c)
+        {
+        case '"': buf << "\\\""; break;
+        case '\\': buf << "\\\\"; break;
+        case '\n': buf << "\\n"; break;
+        case '\r': buf << "\\r"; break;
+        case '\t': buf << "\\t"; break;
+        default:
+            if (c < 0x20)
+                buf << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+            else
+                buf << static_cast<char>(c);
+        }
+    }
+}
+
+// The full failure text of a result, including its line when it has one
+static inline std::string plain_reason(const test_result& result)
+{
+    if (!result.line)
+        return result.reason;
+    return "Line " + std::to_string(result.line) + ": " + result.reason;
+}
+
+// JUnit XML. The document is written as results arrive, so the suite element
+// carries the test count but not the failure count, which isn't known until
+// the end; consumers count failures from the test cases. A run repeated until
+// a failure doesn't know its test count either, and leaves it out.
+class junit_reporter : public reporter
+{
+public:
+    inline explicit junit_reporter(out_buffer& buf)
+        : reporter(buf)
+    {}
+
+    inline void run_starting(const run_state& state) override
+    {
+        buf << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            << "<testsuites>\n"
+            << "  <testsuite name=\"ccut\"";
+        if (state.planned)
+            buf << " tests=\"" << state.planned << '"';
+        buf << ">\n";
+        if (state.shuffled)
+            buf << "    <properties>\n      <property name=\"seed\" value=\"" << state.seed << "\"/>\n    </properties>\n";
+    }
+
+    inline void test_finished(const run_state& state, size_t index) override
+    {
+        const test_result& result = state.results[index];
+        const char* name = state.order[index]->name;
+
+        buf << "    <testcase classname=\"ccut\" name=\"";
+        append_xml_escaped(buf, name, std::strlen(name));
+        buf << "\" time=\"";
+        buf.fixed(result.wall_ns / 1e9, 6);
+        buf << '"';
+
+        if (result.status == test_status::pass)
+        {
+            buf << "/>\n";
+            return;
+        }
+        if (result.status == test_status::skipped)
+        {
+            buf << ">\n      <skipped message=\"";
+            append_xml_escaped(buf, result.reason.data(), result.reason.size());
+            buf << "\"/>\n    </testcase>\n";
+            return;
+        }
+
+        // Assertion failures are failures; anything else is an error
+        const char* element = result.status == test_status::fail ? "failure" : "error";
+        std::string reason = plain_reason(result);
+
+        buf << ">\n      <" << element << " type=\"" << status_name(result.status) << "\" message=\"";
+        append_xml_escaped(buf, reason.data(), reason.size());
+        buf << "\">";
+        append_xml_escaped(buf, reason.data(), reason.size());
+        buf << "</" << element << ">\n    </testcase>\n";
+    }
+
+    inline void run_finished(const run_state&, uint64_t) override
+    {
+        buf << "  </testsuite>\n</testsuites>\n";
+    }
+};
+
+// One JSON object per line: a "test" record per result, then a "summary"
+class jsonl_reporter : public reporter
+{
+public:
+    inline explicit jsonl_reporter(out_buffer& buf)
+        : reporter(buf)
+    {}
+
+    inline void test_finished(const run_state& state, size_t index) override
+    {
+        const test_result& result = state.results[index];
+        const char* name = state.order[index]->name;
+
+        buf << "{\"type\":\"test\",\"name\":\"";
+        append_json_escaped(buf, name, std::strlen(name));
+        buf << "\",\"status\":\"" << status_name(result.status) << "\",\"line\":" << result.line << ",\"message\":\"";
+        append_json_escaped(buf, result.reason.data(), result.reason.size());
+        buf << "\",\"wall_ns\":" << result.wall_ns << ",\"cpu_ns\":" << result.cpu_ns;
+        if (state.track_allocs)
+            buf << ",\"allocs\":" << result.allocs << ",\"alloc_bytes\":" << result.alloc_bytes;
+        if (!state.counters.empty())
+        {
+            buf << ",\"counters\":{";
+            for (size_t i = 0; i < state.counters.size(); i++)
+            {
+                buf << (i ? ",\"" : "\"") << hw_event_names[static_cast<size_t>(state.counters[i])] << "\":"
+                    << result.counters[i];
+            }
+            buf << '}';
+        }
+        buf << "}\n";
+    }
+
+    inline void run_finished(const run_state& state, uint64_t total_ns) override
+    {
+        buf << "{\"type\":\"summary\",\"total\":" << state.reported << ",\"passed\":" << state.passed
+            << ",\"failed\":" << state.reported - state.passed
+            << ",\"filtered\":" << state.registered - state.selected << ",\"repetitions\":" << state.repetitions;
+        if (state.shuffled)
+            buf << ",\"seed\":" << state.seed;
+        buf << ",\"wall_ns\":" << total_ns << "}\n";
+    }
+};
+
+// Test Anything Protocol, version 13, with a YAML block per test
+class tap_reporter : public reporter
+{
+public:
+    inline explicit tap_reporter(out_buffer& buf)
+        : reporter(buf)
+    {}
+
+    // The plan goes first when the number of tests is known, and last otherwise
+    inline void run_starting(const run_state& state) override
+    {
+        buf << "TAP version 13\n";
+        if (state.planned)
+            buf << "1.." << state.planned << "\n";
+        if (state.shuffled)
+            buf << "# seed: " << state.seed << "\n";
+    }
+
+    inline void test_finished(const run_state& state, size_t index) override
+    {
+        const test_result& result = state.results[index];
+        bool ok = result.status == test_status::pass;
+        bool skipped = result.status == test_status::skipped;
+
+        buf << (ok || skipped ? "ok " : "not ok ") << state.first + index + 1 << " - " << state.order[index]->name;
+        if (skipped)
+            buf << " # SKIP " << result.reason;
+        buf << "\n"
+            << "  ---\n"
+            << "  status: " << status_name(result.status) << "\n"
+            << "  duration_ms: ";
+        buf.fixed(result.wall_ns / 1e6, 3);
+        buf << "\n";
+
+        if (!ok)
+        {
+            buf << "  line: " << result.line << "\n  message: \"";
+            append_json_escaped(buf, result.reason.data(), result.reason.size());
+            buf << "\"\n";
+        }
+        buf << "  ...\n";
+    }
+
+    inline void run_finished(const run_state& state, uint64_t) override
+    {
+        if (!state.planned)
+            buf << "1.." << state.reported << "\n";
+    }
+};
+
+//           //
+// Baselines //
+//           //
+
+// Test wall times shorter than this are too noisy to compare with a baseline
+static constexpr double baseline_noise_floor_ns = 1e6;
+
+// Timings from an earlier passing run, and the timings this run makes for
+// the next one. The file holds one line per test or benchmark,
+//     kind <tab> nanoseconds <tab> name
+// where kind is "test" for a test's wall time or "bench" for a benchmark's
+// mean time per call. Repeated tests are recorded by their median.
+class baseline
+{
+public:
+    inline explicit baseline(double tolerance)
+        : tolerance(tolerance)
+    {}
+
+    // Read a baseline file, returning false if it exists but can't be read.
+    // A missing file leaves nothing to compare against.
+    inline bool load(const std::string& path)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "r");
+        if (!file)
+            return errno == ENOENT;
+
+        char line[4096];
+        bool ok = true;
+        while (ok && std::fgets(line, sizeof(line), file))
+        {
+            char* kind_end = std::strchr(line, '\t');
+            char* ns_end = nullptr;
+            double ns = kind_end ? std::strtod(kind_end + 1, &ns_end) : 0;
+            if (!kind_end || ns_end == kind_end + 1 || *ns_end != '\t')
+            {
+                ok = false;
+                break;
+            }
+
+            std::string name(ns_end + 1);
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r'))
+            {
+                name.pop_back();
+            }
+            entries.push_back({std::string(line, kind_end), std::move(name), ns});
+        }
+        ok = ok && !std::ferror(file);
+        std::fclose(file);
+
+        std::sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) {
+            return a.kind != b.kind ? a.kind < b.kind : a.name < b.name;
+        });
+        loaded = true;
+        return ok;
+    }
+
+    // Whether a baseline file existed to compare against
+    inline bool exists() const
+    {
+        return loaded;
+    }
+
+    // Compare a time against the baseline, explaining any regression beyond
+    // the tolerance. Differences below the floor are never regressions.
+    inline bool regressed(const char* kind, const char* name, double ns, double floor_ns, std::string& reason) const
+    {
+        const entry* it = find(kind, name);
+        if (!it)
+            return false;
+        if (ns <= it->ns * (1 + tolerance / 100) || ns - it->ns < floor_ns)
+            return false;
+
+        std::ostringstream os;
+        os.setf(std::ios::fixed);
+        os.precision(1);
+        os << "Took " << format_op_time(ns) << ", " << 100 * (ns / std::max(it->ns, 1e-9) - 1)
+           << "% slower than the baseline's " << format_op_time(it->ns) << " (tolerance " << tolerance << "%)";
+        reason = os.str();
+        return true;
+    }
+
+    inline void record(const char* kind, const char* name, double ns)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        recorded.push_back({kind, name, ns});
+    }
+
+    // The baseline's time for a test or benchmark, or 0 if it has none
+    inline double lookup(const char* kind, const char* name) const
+    {
+        const entry* it = find(kind, name);
+        return it ? it->ns : 0;
+    }
+
+    // Write what this run recorded, replacing the file
+    inline bool save(const std::string& path)
+    {
+        std::unique_ptr<out_buffer> file = out_buffer::open(path.c_str());
+        if (!file)
+            return false;
+
+        std::sort(recorded.begin(), recorded.end(), [](const entry& a, const entry& b) {
+            if (a.kind != b.kind)
+                return a.kind < b.kind;
+            return a.name != b.name ? a.name < b.name : a.ns < b.ns;
+        });
+        for (size_t begin = 0, end; begin < recorded.size(); begin = end)
+        {
+            for (end = begin; end < recorded.size() && recorded[end].kind == recorded[begin].kind
+                              && recorded[end].name == recorded[begin].name;
+                 end++)
+            {}
+
+            const entry& median = recorded[begin + (end - begin) / 2];
+            *file << median.kind << '\t';
+            file->fixed(median.ns, 3);
+            *file << '\t' << median.name << '\n';
+        }
+        file->flush();
+        return true;
+    }
+
+private:
+    struct entry
+    {
+        std::string kind;
+        std::string name;
+        double ns;
+    };
+
+    inline const entry* find(const char* kind, const char* name) const
+    {
+        auto it = std::lower_bound(entries.begin(), entries.end(), entry{kind, name, 0}, [](const entry& a, const entry& b) {
+            return a.kind != b.kind ? a.kind < b.kind : a.name < b.name;
+        });
+        if (it == entries.end() || it->kind != kind || it->name != name)
+            return nullptr;
+        return &*it;
+    }
+
+    double tolerance; // Percent
+    bool loaded = false;
+    std::vector<entry> entries;
+    std::mutex mutex;
+    std::vector<entry> recorded;
+};
+
+//              //
+// Result Cache //
+//              //
+
+// FNV-1a, for keying cache entries by test name
+static inline uint64_t hash_name(const char* name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name; name++)
+    {
+        hash = (hash ^ static_cast<unsigned char>(*name)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Where a test's code sits relative to the runner's. This moves whenever the
+// code before the test changes size, so a moved test is treated as changed:
+// it can run when it didn't need to, but an edited test is rarely missed.
+static inline uint64_t code_position(const RegisterTest* test)
+{
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(test->func))
+        - static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&hash_name));
+}
+
+// What earlier runs learned about each test: its last status, how long it
+// took and where its code was. The file is
+//     8-byte magic | u64 entry count | entries sorted by name hash
+// with each entry
+//     u64 name hash | u64 code position | u64 wall ns | u8 status | 7 bytes padding
+// in native byte order. It is memory-mapped and searched in place, so looking
+// a test up costs the same whether the cache holds ten tests or ten thousand.
+// Each run rewrites it with the tests it ran updated.
+class result_cache
+{
+public:
+    struct entry
+    {
+        uint64_t name_hash;
+        uint64_t code;
+        uint64_t wall_ns;
+        uint8_t status;
+        uint8_t padding[7];
+    };
+
+    inline result_cache() = default;
+
+    inline ~result_cache()
+    {
+#if CCUT_POSIX
+        if (mapped)
+            ::munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    result_cache(const result_cache&) = delete;
+    result_cache& operator=(const result_cache&) = delete;
+
+    // Map a cache file. A missing, unreadable or corrupt file leaves the cache
+    // empty, since it only ever saves time.
+    inline void load(const std::string& path)
+    {
+#if CCUT_POSIX
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* addr = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                data = static_cast<const char*>(addr);
+                size = static_cast<size_t>(info.st_size);
+                mapped = true;
+            }
+        }
+        ::close(fd);
+#else
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file)
+            return;
+        char chunk[4096];
+        for (size_t got; (got = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+        {
+            contents.append(chunk, got);
+        }
+        std::fclose(file);
+        data = contents.data();
+        size = contents.size();
+#endif
+
+        uint64_t stored = 0;
+        if (size >= header_size)
+            std::memcpy(&stored, data + 8, 8);
+        if (size < header_size || std::memcmp(data, magic, 8) != 0 || (size - header_size) / sizeof(entry) != stored
+            || (size - header_size) % sizeof(entry) != 0)
+            stored = 0;
+        count = static_cast<size_t>(stored);
+    }
+
+    // The entry for a test, or false if it has never run
+    inline bool find(uint64_t name_hash, entry& found) const
+    {
+        size_t lo = 0;
+        size_t hi = count;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            std::memcpy(&found, data + header_size + mid * sizeof(entry), sizeof(entry));
+            if (found.name_hash == name_hash)
+                return true;
+            if (found.name_hash < name_hash)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return false;
+    }
+
+    // A test's wall time in the last run, or 0 if it hasn't run since it changed
+    inline uint64_t last_duration(const RegisterTest* test) const
+    {
+        entry found;
+        if (!find(hash_name(test->name), found) || found.code != code_position(test))
+            return 0;
+        return found.wall_ns;
+    }
+
+    // Narrow the selected tests to those that failed last time, have never
+    // run or have changed, unless that leaves none, then order them longest
+    // first by their last duration. Tests with no usable duration go first,
+    // since nothing says they are quick. Also starts recording for them.
+    inline void plan(std::vector<const RegisterTest*>& selected, bool rerun_failed, bool reorder)
+    {
+        std::vector<std::pair<uint64_t, const RegisterTest*>> planned;
+        std::vector<std::pair<uint64_t, const RegisterTest*>> passed;
+        for (const RegisterTest* test : selected)
+        {
+            entry found;
+            bool known = find(hash_name(test->name), found) && found.code == code_position(test);
+            uint64_t wall_ns = known ? found.wall_ns : UINT64_MAX;
+            if (rerun_failed && known && found.status == static_cast<uint8_t>(test_status::pass))
+                passed.push_back({wall_ns, test});
+            else
+                planned.push_back({wall_ns, test});
+        }
+        if (planned.empty())
+            planned.swap(passed);
+
+        if (reorder)
+        {
+            std::stable_sort(planned.begin(), planned.end(),
+                             [](const std::pair<uint64_t, const RegisterTest*>& a,
+                                const std::pair<uint64_t, const RegisterTest*>& b) { return a.first > b.first; });
+        }
+
+        selected.clear();
+        recorded.clear();
+        for (const auto& test : planned)
+        {
+            selected.push_back(test.second);
+            recorded.push_back({hash_name(test.second->name), code_position(test.second), 0, no_result, {}});
+        }
+        std::sort(recorded.begin(), recorded.end(), [](const entry& a, const entry& b) {
+            return a.name_hash < b.name_hash;
+        });
+    }
+
+    // Note a test's result. A failure in any repetition sticks, and tests
+    // the run was stopped before finishing keep what the last run knew.
+    inline void record(const RegisterTest* test, const test_result& result)
+    {
+        if (result.status == test_status::skipped)
+            return;
+
+        uint64_t name_hash = hash_name(test->name);
+        auto it = std::lower_bound(recorded.begin(), recorded.end(), name_hash, [](const entry& e, uint64_t key) {
+            return e.name_hash < key;
+        });
+        if (it == recorded.end() || it->name_hash != name_hash)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (it->status == no_result || it->status == static_cast<uint8_t>(test_status::pass))
+            it->status = static_cast<uint8_t>(result.status);
+        it->wall_ns = std::max(it->wall_ns, result.wall_ns);
+    }
+
+    // Write the cache back with this run's results merged in, replacing the
+    // file only once the new contents are complete
+    inline bool save(const std::string& path)
+    {
+        std::vector<entry> merged;
+        merged.reserve(count + recorded.size());
+        size_t next = 0;
+        for (size_t i = 0; i < count || next < recorded.size();)
+        {
+            entry old = {};
+            if (i < count)
+                std::memcpy(&old, data + header_size + i * sizeof(entry), sizeof(entry));
+            if (next < recorded.size() && (i == count || recorded[next].name_hash <= old.name_hash))
+            {
+                const entry& fresh = recorded[next++];
+                bool same = i < count && fresh.name_hash == old.name_hash;
+                if (fresh.status != no_result)
+                    merged.push_back(fresh);
+                else if (same)
+                    merged.push_back(old);
+                if (same)
+                    i++;
+            }
+            else
+            {
+                merged.push_back(old);
+                i++;
+            }
+        }
+
+        std::string temp = path + ".tmp";
+        std::FILE* file = std::fopen(temp.c_str(), "wb");
+        if (!file)
+            return false;
+        uint64_t stored = merged.size();
+        bool ok = std::fwrite(magic, 1, 8, file) == 8 && std::fwrite(&stored, 8, 1, file) == 1
+            && std::fwrite(merged.data(), sizeof(entry), merged.size(), file) == merged.size();
+        ok = std::fclose(file) == 0 && ok;
+#if !CCUT_POSIX
+        std::remove(path.c_str());
+#endif
+        if (!ok || std::rename(temp.c_str(), path.c_str()) != 0)
+        {
+            int error = errno;
+            std::remove(temp.c_str());
+            errno = error;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr const char* magic = "ccutrc1\n";
+    static constexpr size_t header_size = 16;
+    static constexpr uint8_t no_result = 0xff;
+
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t count = 0; // Entries in the loaded file
+    bool mapped = false;
+#if !CCUT_POSIX
+    std::string contents;
+#endif
+    std::mutex mutex;
+    std::vector<entry> recorded; // This run's results, sorted by name hash
+};
+
+// The reporters for a run, fed together
+class reporter_set
+{
+public:
+    inline void add(std::unique_ptr<reporter> r)
+    {
+        reporters.push_back(std::move(r));
+    }
+
+    inline void run_starting(const run_state& state)
+    {
+        for (auto& r : reporters)
+        {
+            r->run_starting(state);
+        }
+    }
+
+    inline void test_starting(const run_state& state, size_t index)
+    {
+        for (auto& r : reporters)
+        {
+            r->test_starting(state, index);
+        }
+    }
+
+    // Judge passing results against a baseline before they are reported
+    inline void use_baseline(baseline* base)
+    {
+        timings = base;
+    }
+
+    // Remember every result for the next run
+    inline void use_cache(result_cache* results)
+    {
+        cache = results;
+    }
+
+    inline void test_finished(run_state& state, size_t index)
+    {
+        test_result& result = state.results[index];
+        if (timings && result.status == test_status::pass)
+        {
+            const char* name = state.order[index]->name;
+            timings->record("test", name, static_cast<double>(result.wall_ns));
+            if (timings->regressed("test", name, static_cast<double>(result.wall_ns), baseline_noise_floor_ns,
+                                   result.reason))
+                result.status = test_status::fail;
+        }
+        if (cache)
+            cache->record(state.order[index], result);
+
+        if (state.results[index].status == test_status::pass)
+            state.passed++;
+        state.reported++;
+
+        for (auto& r : reporters)
+        {
+            r->test_finished(state, index);
+        }
+
+        // Only the timing is needed after this point
+        std::string().swap(state.results[index].reason);
+    }
+
+    inline void run_finished(const run_state& state, uint64_t total_ns)
+    {
+        for (auto& r : reporters)
+        {
+            r->run_finished(state, total_ns);
+        }
+    }
+
+    // Write out every reporter's pending batch
+    inline void flush()
+    {
+        for (auto& r : reporters)
+        {
+            r->buf.flush();
+        }
+        out().flush();
+    }
+
+    // Flush the reporters whose readers expect progress now
+    inline void sync()
+    {
+        for (auto& r : reporters)
+        {
+            r->buf.sync();
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<reporter>> reporters;
+    baseline* timings = nullptr;
+    result_cache* cache = nullptr;
+};
+
+// Set up the reporters chosen by the options, returning false and printing
+// why if an output file can't be opened. A machine-readable report written to
+// a file is accompanied by the human-readable one on stdout.
+static inline bool make_reporters(const options& opts, reporter_set& report)
+{
+    if (opts.reporter == "human" && opts.output.empty())
+    {
+        report.add(std::unique_ptr<reporter>(new human_reporter(out(), opts.slow_threshold_ns, opts.slowest)));
+        return true;
+    }
+
+    std::unique_ptr<out_buffer> file;
+    if (!opts.output.empty())
+    {
+        file = out_buffer::open(opts.output.c_str());
+        if (!file)
+        {
+            std::cerr << "Could not open \"" << opts.output << "\" for writing: " << std::strerror(errno) << "\n";
+            return false;
+        }
+    }
+    out_buffer& buf = file ? *file : out();
+
+    std::unique_ptr<reporter> chosen;
+    if (opts.reporter == "junit")
+        chosen.reset(new junit_reporter(buf));
+    else if (opts.reporter == "jsonl")
+        chosen.reset(new jsonl_reporter(buf));
+    else if (opts.reporter == "tap")
+        chosen.reset(new tap_reporter(buf));
+    else
+        chosen.reset(new human_reporter(buf, opts.slow_threshold_ns, opts.slowest));
+
+    if (file)
+    {
+        chosen->own(std::move(file));
+        if (opts.reporter != "human")
+            report.add(std::unique_ptr<reporter>(new human_reporter(out(), opts.slow_threshold_ns, opts.slowest)));
+    }
+    report.add(std::move(chosen));
+    return true;
+}
+
+// Each test's wall time in earlier runs, or 0 where nothing is known. A
+// baseline wins over the result cache, since it is the file machines are
+// likely to share.
+static inline std::vector<uint64_t> expected_durations(const std::vector<const RegisterTest*>& tests,
+                                                       const baseline* timings, const result_cache* cache)
+{
+    std::vector<uint64_t> durations(tests.size());
+    for (size_t i = 0; i < tests.size(); i++)
+    {
+        if (timings)
+            durations[i] = static_cast<uint64_t>(timings->lookup("test", tests[i]->name));
+        if (!durations[i] && cache)
+            durations[i] = cache->last_duration(tests[i]);
+    }
+    return durations;
+}
+
+// Longest-processing-time-first packing: items with a known cost, longest
+// first, each go to the bin with the least work so far, ties going to the
+// lowest bin and equal costs keeping their order. Returns each item's bin,
+// or bins for items with no known cost, which the caller places itself.
+static inline std::vector<unsigned> pack_longest_first(const std::vector<size_t>& items,
+                                                       const std::vector<uint64_t>& costs, unsigned bins)
+{
+    std::vector<size_t> known;
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (costs[items[i]])
+            known.push_back(i);
+    }
+    std::stable_sort(known.begin(), known.end(), [&](size_t a, size_t b) {
+        return costs[items[a]] > costs[items[b]];
+    });
+
+    // Min-heap of (work so far, bin)
+    std::vector<std::pair<uint64_t, unsigned>> loads(bins);
+    for (unsigned bin = 0; bin < bins; bin++)
+    {
+        loads[bin] = {0, bin};
+    }
+    auto lighter = std::greater<std::pair<uint64_t, unsigned>>();
+
+    std::vector<unsigned> assigned(items.size(), bins);
+    for (size_t i : known)
+    {
+        std::pop_heap(loads.begin(), loads.end(), lighter);
+        assigned[i] = loads.back().second;
+        loads.back().first += costs[items[i]];
+        std::push_heap(loads.begin(), loads.end(), lighter);
+    }
+    return assigned;
+}
+
+// This node's share of the tests for --shard=i/N. Tests with a history are
+// packed longest first; the rest are placed by a hash of their name, so a
+// new test doesn't move anything else. The split depends only on the tests
+// and their durations, so nodes given the same binary and duration file
+// agree on it without talking to each other.
+static inline std::vector<const RegisterTest*> select_node(const std::vector<const RegisterTest*>& tests,
+                                                           const std::vector<uint64_t>& durations, unsigned node,
+                                                           unsigned nodes)
+{
+    std::vector<size_t> items(tests.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        items[i] = i;
+    }
+    std::vector<unsigned> assigned = pack_longest_first(items, durations, nodes);
+
+    std::vector<const RegisterTest*> share;
+    for (size_t i = 0; i < tests.size(); i++)
+    {
+        unsigned bin = assigned[i] < nodes ? assigned[i] : static_cast<unsigned>(hash_name(tests[i]->name) % nodes);
+        if (bin == node)
+            share.push_back(tests[i]);
+    }
+    return share;
+}
+
+// Split tests into lanes: parallel tests across the given number of lanes,
+// then one final lane holding every serial test. Tests with a known duration
+// are packed longest first so the lanes finish together; the rest are dealt
+// round-robin. Each lane keeps its tests in run order.
+static inline std::vector<std::vector<size_t>> make_lanes(const run_state& state, unsigned count)
+{
+    std::vector<std::vector<size_t>> lanes(count + 1);
+    std::vector<size_t> parallel;
+    for (size_t i = 0; i < state.order.size(); i++)
+    {
+        if (state.order[i]->serial)
+            lanes[count].push_back(i);
+        else
+            parallel.push_back(i);
+    }
+
+    std::vector<unsigned> assigned = pack_longest_first(parallel, state.expected, count);
+    unsigned next = 0;
+    for (size_t i = 0; i < parallel.size(); i++)
+    {
+        if (assigned[i] < count)
+        {
+            lanes[assigned[i]].push_back(parallel[i]);
+        }
+        else
+        {
+            lanes[next].push_back(parallel[i]);
+            next = (next + 1) % count;
+        }
+    }
+    return lanes;
+}
+
+// Watches the threads running tests for one that has run past its time
+// limit. Each thread bumps its epoch as a test starts and again as it ends,
+// so an odd epoch means a test is running. The watcher remembers when it
+// first saw each epoch and measures from there, which keeps clock reads off
+// the test threads at the cost of detecting an overrun up to one check late.
+class watchdog
+{
+public:
+    static constexpr size_t none = static_cast<size_t>(-1);
+
+    inline explicit watchdog(unsigned threads)
+        : beats(new heartbeat[threads])
+        , seen(threads)
+    {}
+
+    inline void test_started(unsigned thread, size_t index)
+    {
+        beats[thread].index.store(index, std::memory_order_relaxed);
+        beats[thread].epoch.fetch_add(1, std::memory_order_release);
+    }
+
+    inline void test_ended(unsigned thread)
+    {
+        beats[thread].epoch.fetch_add(1, std::memory_order_release);
+    }
+
+    // Find a test that has been running longer than its limit, or return none
+    inline size_t check(const run_state& state, uint64_t now, uint64_t& ran_ns)
+    {
+        for (size_t thread = 0; thread < seen.size(); thread++)
+        {
+            uint64_t epoch = beats[thread].epoch.load(std::memory_order_acquire);
+            if (epoch != seen[thread].epoch)
+            {
+                seen[thread].epoch = epoch;
+                seen[thread].since_ns = now;
+                continue;
+            }
+            if (!(epoch & 1))
+                continue;
+
+            size_t index = beats[thread].index.load(std::memory_order_relaxed);
+            uint64_t limit = state.timeouts[index];
+            if (limit && now - seen[thread].since_ns > limit)
+            {
+                ran_ns = now - seen[thread].since_ns;
+                return index;
+            }
+        }
+        return none;
+    }
+
+    // How often to check: often enough to catch the shortest limit promptly
+    static inline std::chrono::nanoseconds period(const run_state& state)
+    {
+        uint64_t shortest = 0;
+        for (uint64_t limit : state.timeouts)
+        {
+            if (limit && (!shortest || limit < shortest))
+                shortest = limit;
+        }
+        return std::chrono::nanoseconds(std::min<uint64_t>(std::max<uint64_t>(shortest / 8, 1000000), 100000000));
+    }
+
+private:
+    struct alignas(64) heartbeat
+    {
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<size_t> index{0};
+    };
+
+    struct sighting
+    {
+        uint64_t epoch = 0;
+        uint64_t since_ns = 0;
+    };
+
+    std::unique_ptr<heartbeat[]> beats;
+    std::vector<sighting> seen; // Only touched by the watching thread
+};
+
+// Describe a test that ran past its limit
+static inline std::string describe_timeout(uint64_t limit_ns)
+{
+    return "Test ran longer than its " + format_duration(limit_ns) + " timeout";
+}
+
+// Run tests on a thread pool, reporting results in registry order. The
+// reporting thread doubles as the watchdog. A thread stuck in a test can't be
+// taken back, so when a test times out the test is reported as such, every
+// test not yet finished is reported as skipped, and false is returned with
+// the pool still running; the caller must end the process without returning.
+static inline bool run_threaded(run_state& state, reporter_set& report, unsigned jobs)
+{
+    // Everything the pool touches lives on the heap, since after a timeout
+    // the pool outlives this call and the shared state is leaked to it
+    struct threaded_run
+    {
+        inline threaded_run(run_state& state, unsigned jobs)
+            : state(state)
+            , jobs(jobs)
+            , done(state.order.size(), 0)
+            , dog(jobs + 2) // The serial lane's thread has the next heartbeat after the workers'
+        {}
+
+        // Results are handed over under the lock, so a test that finishes
+        // after the run has been stopped can't write over what was reported
+        inline void finish(size_t index, test_result& result)
+        {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (done[index])
+                return;
+            state.results[index] = std::move(result);
+            done[index] = 1;
+            done_cv.notify_one();
+        }
+
+        // Once the run has been stopped, queued tests are dropped unstarted
+        inline void run_one(unsigned thread, size_t index)
+        {
+            if (stopped.load(std::memory_order_acquire))
+                return;
+            test_result result;
+            dog.test_started(thread, index);
+            run_test(state.order[index]->func, result);
+            dog.test_ended(thread);
+            finish(index, result);
+        }
+
+        run_state& state;
+        unsigned jobs;
+        std::vector<char> done;
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        watchdog dog;
+        std::atomic<bool> stopped{false};
+        bool drained = false; // Every test has finished or been dropped
+#if CCUT_HAS_COROUTINES
+        // Parallel async tests all run together on a loop with a thread of
+        // its own, which has the last heartbeat
+        async_loop loop;
+        std::vector<async_test> async_tests;
+#endif
+    };
+    std::unique_ptr<threaded_run> shared(new threaded_run(state, jobs));
+    threaded_run* run = shared.get();
+    watchdog& dog = run->dog;
+    std::vector<char>& done = run->done;
+    bool has_timeouts = std::any_of(state.timeouts.begin(), state.timeouts.end(), [](uint64_t t) { return t != 0; });
+
+#if CCUT_HAS_COROUTINES
+    async_loop& loop = run->loop;
+    loop.isolate = true;
+    loop.on_slice = [run](const async_test& test, bool running) {
+        if (running)
+            run->dog.test_started(run->jobs + 1, test.index);
+        else
+            run->dog.test_ended(run->jobs + 1);
+    };
+    loop.on_finished = [run](async_test& test) {
+        take_async_result(test);
+        run->finish(test.index, test.result);
+    };
+#endif
+
+    // Parallel tests go to the pool, then serial tests run alone afterwards
+    std::thread scheduler([run]() {
+        run_state& state = run->state;
+        unsigned jobs = run->jobs;
+        std::vector<std::vector<size_t>> lanes = make_lanes(state, jobs);
+
+#if CCUT_HAS_COROUTINES
+        std::vector<size_t> async_indices;
+        auto is_async = [&](size_t index) { return state.order[index]->async != nullptr; };
+        for (unsigned worker = 0; worker < jobs; worker++)
+        {
+            std::vector<size_t>& lane = lanes[worker];
+            std::copy_if(lane.begin(), lane.end(), std::back_inserter(async_indices), is_async);
+            lane.erase(std::remove_if(lane.begin(), lane.end(), is_async), lane.end());
+        }
+        std::sort(async_indices.begin(), async_indices.end());
+
+        std::vector<async_test>& async_tests = run->async_tests;
+        async_tests = std::vector<async_test>(async_indices.size());
+        for (size_t i = 0; i < async_indices.size(); i++)
+        {
+            async_tests[i].index = async_indices[i];
+            run->loop.add(async_tests[i], state.order[async_indices[i]]->async);
+        }
+        std::thread async_thread([run]() { run->loop.run(); });
+#endif
+
+        work_stealing_pool pool(jobs);
+        for (unsigned worker = 0; worker < jobs; worker++)
+        {
+            for (size_t index : lanes[worker])
+            {
+                pool.push(worker, index);
+            }
+        }
+
+        pool.run([run](unsigned thread, size_t index) { run->run_one(thread, index); });
+#if CCUT_HAS_COROUTINES
+        async_thread.join();
+#endif
+
+        for (size_t index : lanes[jobs])
+        {
+            run->run_one(jobs, index);
+        }
+
+        std::lock_guard<std::mutex> lock(run->done_mutex);
+        run->drained = true;
+        run->done_cv.notify_one();
+    });
+
+    // Give the timed out test its result and everything unfinished a skip.
+    // Called with the lock held.
+    auto stop = [&](size_t expired, uint64_t ran_ns) {
+        run->stopped.store(true, std::memory_order_release);
+
+        test_result& result = state.results[expired];
+        result.status = test_status::timeout;
+        result.reason = describe_timeout(state.timeouts[expired]);
+        result.wall_ns = ran_ns;
+        done[expired] = 1;
+
+        std::string reason = std::string("Run stopped after \"") + state.order[expired]->name + "\" timed out";
+        for (size_t i = 0; i < state.order.size(); i++)
+        {
+            if (!done[i])
+            {
+                state.results[i].status = test_status::skipped;
+                state.results[i].reason = reason;
+                done[i] = 1;
+            }
+        }
+    };
+
+    // A stuck test found by the watchdog
+    auto find_expired = [&](uint64_t& ran_ns) {
+        size_t expired = dog.check(state, wall_now_ns(), ran_ns);
+#if CCUT_HAS_COROUTINES
+        if (expired == watchdog::none)
+            expired = loop.check(state.timeouts, wall_now_ns(), ran_ns);
+#endif
+        return expired;
+    };
+
+    // Report results in order as they become available
+    std::chrono::nanoseconds period = watchdog::period(state);
+    bool stopped = false;
+    bool cut_short = false;
+    for (size_t i = 0; i < state.order.size() && !cut_short; i++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(run->done_mutex);
+            if (!done[i])
+            {
+                // Write out the batch so far rather than sit on it while waiting
+                lock.unlock();
+                report.flush();
+                lock.lock();
+
+                if (!has_timeouts)
+                    run->done_cv.wait(lock, [&]() { return done[i] != 0; });
+
+                while (!done[i])
+                {
+                    run->done_cv.wait_for(lock, period);
+
+                    uint64_t ran_ns = 0;
+                    size_t expired = find_expired(ran_ns);
+                    if (expired != watchdog::none && !done[expired])
+                    {
+                        stop(expired, ran_ns);
+                        stopped = true;
+                    }
+                }
+            }
+        }
+
+        report.test_starting(state, i);
+        report.test_finished(state, i);
+        cut_short = pass_stops_run(state, i);
+    }
+
+    // Drop the queued tests of later passes and wait out the running ones,
+    // still watching their limits, since they won't be reported
+    if (cut_short && !stopped)
+    {
+        run->stopped.store(true, std::memory_order_release);
+        std::unique_lock<std::mutex> lock(run->done_mutex);
+        while (!run->drained && !stopped)
+        {
+            run->done_cv.wait_for(lock, period);
+            uint64_t ran_ns = 0;
+            stopped = has_timeouts && find_expired(ran_ns) != watchdog::none;
+        }
+    }
+
+    if (stopped)
+    {
+        scheduler.detach();
+        shared.release();
+        return false;
+    }
+    scheduler.join();
+    return true;
+}
+
+//                   //
+// Process Isolation //
+//                   //
+
+#if CCUT_HAS_FORK
+
+// Results travel from shard processes to the parent as records of
+//     u32 test index | u8 status | u64 wall ns | u64 cpu ns | u64 allocs | u64 alloc bytes | i32 line
+//     | u32 reason length | u64 count of each hw_events() entry | reason bytes
+// in native byte order, since both ends are the same binary.
+static constexpr size_t shard_record_header = 45;
+
+static inline void append_shard_record(std::string& out, uint32_t index, const test_result& result)
+{
+    uint8_t status = static_cast<uint8_t>(result.status);
+    uint32_t reason_len = static_cast<uint32_t>(result.reason.size());
+
+    char header[shard_record_header];
+    std::memcpy(header, &index, 4);
+    std::memcpy(header + 4, &status, 1);
+    std::memcpy(header + 5, &result.wall_ns, 8);
+    std::memcpy(header + 13, &result.cpu_ns, 8);
+    std::memcpy(header + 21, &result.allocs, 8);
+    std::memcpy(header + 29, &result.alloc_bytes, 8);
+    std::memcpy(header + 37, &result.line, 4);
+    std::memcpy(header + 41, &reason_len, 4);
+
+    out.append(header, sizeof(header));
+    out.append(reinterpret_cast<const char*>(result.counters.data()), hw_events().size() * sizeof(uint64_t));
+    out.append(result.reason);
+}
+
+// A child process running one lane of tests, and what the parent has read from it
+struct shard_process
+{
+    const std::vector<size_t>* lane = nullptr;
+    size_t next = 0;       // Position in lane of the first test with no result yet
+    uint64_t since_ns = 0; // When that test started, as near as the parent can tell
+    pid_t pid = -1;
+    int fd = -1;
+    std::string buffer;
+};
+
+// Child side of a shard: run the rest of the lane and stream each result back.
+// Every result is written as soon as it exists, so after a crash the parent
+// knows exactly which test was running.
+[[noreturn]] static inline void run_shard_child(const run_state& state, const shard_process& shard, int fd)
+{
+    std::string record;
+    for (size_t pos = shard.next; pos < shard.lane->size(); pos++)
+    {
+        size_t index = (*shard.lane)[pos];
+
+        test_result result;
+        run_test(state.order[index]->func, result);
+
+        // Flush the test's own output before its result is seen
+        std::cout.flush();
+
+        record.clear();
+        append_shard_record(record, static_cast<uint32_t>(index), result);
+        if (!write_all(fd, record.data(), record.size()))
+            break;
+    }
+
+    std::cout.flush();
+    std::fflush(stdout);
+    ::_exit(0);
+}
+
+// Fork a child to run a shard's remaining tests
+static inline bool start_shard(const run_state& state, std::vector<shard_process>& shards, shard_process& shard)
+{
+    int fds[2];
+    if (::pipe(fds) != 0)
+        return false;
+
+    // Anything still buffered would otherwise be written by both processes
+    out().flush();
+
+    pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        ::close(fds[0]);
+        for (const auto& other : shards)
+        {
+            if (other.fd >= 0)
+                ::close(other.fd);
+        }
+        run_shard_child(state, shard, fds[1]);
+    }
+
+    ::close(fds[1]);
+    shard.pid = pid;
+    shard.fd = fds[0];
+    shard.since_ns = wall_now_ns();
+    return true;
+}
+
+// Describe why a shard process stopped before finishing its lane
+static inline std::string describe_exit(int status)
+{
+    std::ostringstream os;
+    if (WIFSIGNALED(status))
+    {
+        int sig = WTERMSIG(status);
+        os << "Test process crashed with signal " << sig;
+        if (const char* name = ::strsignal(sig))
+            os << " (" << name << ")";
+    }
+    else if (WIFEXITED(status))
+    {
+        os << "Test process exited early with code " << WEXITSTATUS(status);
+    }
+    else
+    {
+        os << "Test process stopped for an unknown reason";
+    }
+    return os.str();
+}
+
+// Parse complete records out of a shard's buffer, returning finished test indices
+template <typename Finish>
+static inline void drain_shard_records(run_state& state, shard_process& shard, Finish&& finish)
+{
+    size_t pos = 0;
+    while (shard.buffer.size() - pos >= shard_record_header)
+    {
+        const char* header = shard.buffer.data() + pos;
+        uint32_t index;
+        uint8_t status;
+        uint32_t reason_len;
+        std::memcpy(&index, header, 4);
+        std::memcpy(&status, header + 4, 1);
+        std::memcpy(&reason_len, header + 41, 4);
+
+        size_t counters_len = state.counters.size() * sizeof(uint64_t);
+        if (shard.buffer.size() - pos - shard_record_header < counters_len + reason_len)
+            break;
+
+        test_result& result = state.results[index];
+        result.status = static_cast<test_status>(status);
+        std::memcpy(&result.wall_ns, header + 5, 8);
+        std::memcpy(&result.cpu_ns, header + 13, 8);
+        std::memcpy(&result.allocs, header + 21, 8);
+        std::memcpy(&result.alloc_bytes, header + 29, 8);
+        std::memcpy(&result.line, header + 37, 4);
+        std::memcpy(result.counters.data(), header + shard_record_header, counters_len);
+        result.reason.assign(header + shard_record_header + counters_len, reason_len);
+
+        pos += shard_record_header + counters_len + reason_len;
+        shard.next++;
+        finish(index);
+    }
+    shard.buffer.erase(0, pos);
+    if (pos)
+        shard.since_ns = wall_now_ns();
+}
+
+// Run lanes concurrently, one child process per lane. When a child dies the
+// test it was running is reported as crashed, and a new child picks the lane
+// back up at the following test. A child whose test runs past its time limit
+// is killed and the test reported as timed out, with the lane picked up in the
+// same way.
+template <typename Finish>
+static inline void run_shard_lanes(run_state& state, reporter_set& report, const std::vector<std::vector<size_t>>& lanes,
+                                   Finish&& finish, const bool& cut_short)
+{
+    std::vector<shard_process> shards(lanes.size());
+    for (size_t i = 0; i < lanes.size(); i++)
+    {
+        shards[i].lane = &lanes[i];
+    }
+
+    // Mark the test a shard will run next as failed to run and move past it
+    auto abandon_next = [&](shard_process& shard, test_status status, std::string reason) {
+        size_t index = (*shard.lane)[shard.next++];
+        state.results[index].status = status;
+        state.results[index].reason = std::move(reason);
+        finish(index);
+    };
+
+    auto launch = [&](shard_process& shard) {
+        while (shard.next < shard.lane->size() && !start_shard(state, shards, shard))
+        {
+            abandon_next(shard, test_status::crash, std::string("Could not start test process: ") + std::strerror(errno));
+        }
+    };
+
+    // Read whatever a stopped child wrote last, then collect it
+    char chunk[65536];
+    auto reap = [&](shard_process& shard) {
+        for (;;)
+        {
+            ssize_t got = ::read(shard.fd, chunk, sizeof(chunk));
+            if (got > 0)
+                shard.buffer.append(chunk, static_cast<size_t>(got));
+            else if (!(got < 0 && errno == EINTR))
+                break;
+        }
+        drain_shard_records(state, shard, finish);
+
+        ::close(shard.fd);
+        shard.fd = -1;
+        shard.buffer.clear();
+
+        int status = 0;
+        while (::waitpid(shard.pid, &status, 0) < 0 && errno == EINTR)
+        {}
+        shard.pid = -1;
+        return status;
+    };
+
+    // Kill a child stuck in a test. Its test may have finished just before
+    // the kill, in which case the lane simply carries on.
+    auto time_out = [&](shard_process& shard, uint64_t now) {
+        size_t index = (*shard.lane)[shard.next];
+        uint64_t ran_ns = now - shard.since_ns;
+        ::kill(shard.pid, SIGKILL);
+        reap(shard);
+
+        if (shard.next < shard.lane->size() && (*shard.lane)[shard.next] == index)
+        {
+            state.results[index].wall_ns = ran_ns;
+            abandon_next(shard, test_status::timeout, describe_timeout(state.timeouts[index]));
+        }
+        launch(shard);
+    };
+
+    for (auto& shard : shards)
+    {
+        launch(shard);
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<shard_process*> polled;
+    for (;;)
+    {
+        // Once the batch is cut short, the children are only running tests
+        // that won't be reported
+        if (cut_short)
+        {
+            for (auto& shard : shards)
+            {
+                if (shard.fd >= 0)
+                {
+                    ::kill(shard.pid, SIGKILL);
+                    reap(shard);
+                }
+            }
+            break;
+        }
+
+        // Time out stuck children, and wait no longer than the next deadline
+        int wait_ms = -1;
+        uint64_t now = wall_now_ns();
+        for (auto& shard : shards)
+        {
+            if (shard.fd < 0 || shard.next >= shard.lane->size())
+                continue;
+
+            uint64_t limit = state.timeouts[(*shard.lane)[shard.next]];
+            if (!limit)
+                continue;
+            if (now - shard.since_ns >= limit)
+            {
+                time_out(shard, now);
+                now = wall_now_ns();
+                wait_ms = 0;
+                continue;
+            }
+
+            int remaining_ms = static_cast<int>(std::min<uint64_t>((shard.since_ns + limit - now + 999999) / 1000000, 60000));
+            if (wait_ms < 0 || remaining_ms < wait_ms)
+                wait_ms = remaining_ms;
+        }
+
+        fds.clear();
+        polled.clear();
+        for (auto& shard : shards)
+        {
+            if (shard.fd >= 0)
+            {
+                fds.push_back({shard.fd, POLLIN, 0});
+                polled.push_back(&shard);
+            }
+        }
+        if (fds.empty())
+            break;
+
+        // Write out the batch so far rather than sit on it while waiting
+        report.flush();
+
+        if (::poll(fds.data(), fds.size(), wait_ms) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (!fds[i].revents)
+                continue;
+
+            shard_process& shard = *polled[i];
+            ssize_t got = ::read(shard.fd, chunk, sizeof(chunk));
+            if (got > 0)
+            {
+                shard.buffer.append(chunk, static_cast<size_t>(got));
+                drain_shard_records(state, shard, finish);
+                continue;
+            }
+            if (got < 0 && errno == EINTR)
+                continue;
+
+            // The child closed its end, either done or dead
+            int status = reap(shard);
+            if (shard.next < shard.lane->size())
+            {
+                abandon_next(shard, test_status::crash, describe_exit(status));
+                launch(shard);
+            }
+        }
+    }
+}
+
+// Run tests in child processes, reporting results in registry order
+static inline void run_forked(run_state& state, reporter_set& report, unsigned shard_count)
+{
+    std::vector<char> done(state.order.size(), 0);
+    size_t next = 0;
+    bool cut_short = false;
+
+    auto finish = [&](size_t index) {
+        done[index] = 1;
+        for (; !cut_short && next < state.order.size() && done[next]; next++)
+        {
+            report.test_starting(state, next);
+            report.test_finished(state, next);
+            cut_short = pass_stops_run(state, next);
+        }
+    };
+
+    // Parallel lanes run concurrently, then the serial lane runs on its own
+    std::vector<std::vector<size_t>> lanes = make_lanes(state, shard_count);
+    std::vector<std::vector<size_t>> serial_lane(1);
+    serial_lane[0].swap(lanes.back());
+    lanes.pop_back();
+
+    run_shard_lanes(state, report, lanes, finish, cut_short);
+    if (!cut_short)
+        run_shard_lanes(state, report, serial_lane, finish, cut_short);
+}
+
+// Death tests run their statement in a forked child, with its stderr going
+// into one pipe and a second pipe on which it says so if the statement comes
+// back instead of ending the process. The child is a fresh fork() of the
+// test's process rather than one started in advance, since the statement
+// can use anything the test has set up by then.
+
+// How a statement run in a child process ended
+struct child_outcome
+{
+    enum end_type
+    {
+        returned,  // The statement finished normally
+        threw,     // The statement threw, as a failed ASSERT_* does
+        exited,    // The process exited, with code
+        signaled,  // The process was killed by signal number code
+        unstarted, // The child couldn't be forked
+        timed_out, // The child was killed for running past child_limit_ns
+    };
+
+    end_type end = unstarted;
+    int code = 0;
+    std::string output; // Everything the child wrote to stderr
+    std::string detail; // What the statement threw, or why there was no child
+};
+
+// A statement's child is killed if it hasn't ended after this long. Locks
+// held by other threads at the fork stay held in the child, so a statement
+// can deadlock there, and the run shouldn't hang on it.
+static constexpr uint64_t child_limit_ns = 60000000000ull;
+
+// Held from making a child's pipes until the parent has closed its copies of
+// their write ends. A child forked on another worker doesn't exec, so
+// close-on-exec alone wouldn't keep it from holding them open and keeping
+// the parent from seeing end of file.
+inline std::mutex& child_fork_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Make a pipe whose ends are closed on exec
+static inline bool open_child_pipe(int fds[2])
+{
+#if defined(__linux__)
+    return ::pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (::pipe(fds) != 0)
+        return false;
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+// Start a statement's child. Returns its pid to the parent, 0 to the child,
+// or -1 with the reason in outcome.detail.
+static inline pid_t fork_statement_child(int& output_fd, int& status_fd, child_outcome& outcome)
+{
+    std::lock_guard<std::mutex> lock(child_fork_mutex());
+    int output[2];
+    int status[2];
+    if (!open_child_pipe(output))
+    {
+        outcome.detail = std::strerror(errno);
+        return -1;
+    }
+    if (!open_child_pipe(status))
+    {
+        outcome.detail = std::strerror(errno);
+        ::close(output[0]);
+        ::close(output[1]);
+        return -1;
+    }
+
+    // Anything still buffered would otherwise be written by both processes
+    out().flush();
+    std::cout.flush();
+    std::fflush(nullptr);
+
+    pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        outcome.detail = std::strerror(errno);
+        for (int fd : {output[0], output[1], status[0], status[1]})
+        {
+            ::close(fd);
+        }
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        // Whatever the child writes to stdout, or flushes as it exits, would
+        // land in the middle of the report
+        int null_fd = ::open("/dev/null", O_WRONLY);
+        if (null_fd >= 0)
+        {
+            ::dup2(null_fd, STDOUT_FILENO);
+            ::close(null_fd);
+        }
+        ::dup2(output[1], STDERR_FILENO);
+        ::close(output[0]);
+        ::close(output[1]);
+        ::close(status[0]);
+        status_fd = status[1];
+        return 0;
+    }
+
+    ::close(output[1]);
+    ::close(status[1]);
+    output_fd = output[0];
+    status_fd = status[0];
+    return pid;
+}
+
+// Child side: tell the parent the statement came back, and leave without
+// running exit handlers
+[[noreturn]] static inline void end_statement_child(int status_fd, child_outcome::end_type end, const char* detail)
+{
+    std::string message(1, static_cast<char>(end));
+    message += detail;
+    write_all(status_fd, message.data(), message.size());
+    ::_exit(0);
+}
+
+// Parent side: collect the child's stderr and how it ended, killing it if it
+// runs past child_limit_ns
+static inline void wait_statement_child(pid_t pid, int output_fd, int status_fd, child_outcome& outcome)
+{
+    std::string status;
+    pollfd fds[2] = {{output_fd, POLLIN, 0}, {status_fd, POLLIN, 0}};
+    std::string* into[2] = {&outcome.output, &status};
+    uint64_t deadline = wall_now_ns() + child_limit_ns;
+    bool killed = false;
+    char chunk[4096];
+
+    // Read both pipes until the child closes them, which poll() stops
+    // watching once their fds are set negative
+    while (fds[0].fd >= 0 || fds[1].fd >= 0)
+    {
+        uint64_t now = wall_now_ns();
+        if (now >= deadline)
+        {
+            ::kill(pid, SIGKILL);
+            killed = true;
+            break;
+        }
+
+        int wait_ms = static_cast<int>(std::min<uint64_t>((deadline - now + 999999) / 1000000, 60000));
+        if (::poll(fds, 2, wait_ms) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ::kill(pid, SIGKILL);
+            killed = true;
+            break;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (fds[i].fd < 0 || !fds[i].revents)
+                continue;
+            ssize_t got = ::read(fds[i].fd, chunk, sizeof(chunk));
+            if (got > 0)
+                into[i]->append(chunk, static_cast<size_t>(got));
+            else if (!(got < 0 && errno == EINTR))
+                fds[i].fd = -1;
+        }
+    }
+    ::close(output_fd);
+    ::close(status_fd);
+
+    int wait_status = 0;
+    while (::waitpid(pid, &wait_status, 0) < 0 && errno == EINTR)
+    {
+    }
+
+    if (killed)
+    {
+        outcome.end = child_outcome::timed_out;
+        outcome.detail = format_duration(child_limit_ns);
+    }
+    else if (!status.empty())
+    {
+        outcome.end = static_cast<child_outcome::end_type>(status[0]);
+        outcome.detail = status.substr(1);
+    }
+    else if (WIFSIGNALED(wait_status))
+    {
+        outcome.end = child_outcome::signaled;
+        outcome.code = WTERMSIG(wait_status);
+    }
+    else
+    {
+        outcome.end = child_outcome::exited;
+        outcome.code = WEXITSTATUS(wait_status);
+    }
+}
+
+// Run a statement in a child process and report how it ended. With --jobs,
+// only the calling thread exists in the child, and any lock another thread
+// held at the fork stays held there, so statements that need more than the
+// allocator and stdio are best kept to serial tests. A child stuck on such a
+// lock is killed after child_limit_ns and fails the check.
+template <typename Statement>
+static inline child_outcome run_statement_in_child(const Statement& statement)
+{
+    child_outcome outcome;
+    int output_fd = -1;
+    int status_fd = -1;
+    pid_t pid = fork_statement_child(output_fd, status_fd, outcome);
+    if (pid == 0)
+    {
+#if !CCUT_NO_EXCEPTIONS
+        try
+        {
+            statement();
+        }
+        catch (const ccut_exception& ce)
+        {
+            end_statement_child(status_fd, child_outcome::threw, ce.get_reason().c_str());
+        }
+        catch (const std::exception& e)
+        {
+            end_statement_child(status_fd, child_outcome::threw, e.what());
+        }
+        catch (...)
+        {
+            end_statement_child(status_fd, child_outcome::threw, "an unknown exception");
+        }
+#else
+        statement();
+#endif
+        end_statement_child(status_fd, child_outcome::returned, "");
+    }
+    if (pid > 0)
+        wait_statement_child(pid, output_fd, status_fd, outcome);
+    return outcome;
+}
+
+#endif // if CCUT_HAS_FORK
+
+//          //
+// Fixtures //
+//          //
+
+// Optional base for fixtures used with TEST_F(), so a fixture only needs to
+// define the hooks it uses. SetUp() and TearDown() run around every test;
+// SetUpSuite() runs once, before the first test of the fixture type, and
+// TearDownSuite() after the last test of the run.
+struct test_fixture
+{
+    void SetUp() {}
+    void TearDown() {}
+    static void SetUpSuite() {}
+    static void TearDownSuite() {}
+};
+
+// Idle instances of one fixture type. A test takes an instance, or builds one
+// if none is idle, and puts it back afterwards, so a run builds at most one
+// instance per concurrently running test rather than one per test. An
+// instance is reused as is, so SetUp() must reset whatever a test changes.
+template <typename Fixture>
+class fixture_pool
+{
+public:
+    // Function-local static of a member of a class template, so one pool per
+    // fixture type is shared by every translation unit
+    static inline fixture_pool& get()
+    {
+        static fixture_pool pool;
+        return pool;
+    }
+
+    inline std::unique_ptr<Fixture> acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty())
+            {
+                std::unique_ptr<Fixture> instance = std::move(idle.back());
+                idle.pop_back();
+                return instance;
+            }
+        }
+        return std::unique_ptr<Fixture>(new Fixture());
+    }
+
+    inline void release(std::unique_ptr<Fixture> instance)
+    {
+        untracked_allocs untracked;
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(std::move(instance));
+    }
+
+    inline void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.clear();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Fixture>> idle;
+};
+
+// Suite teardowns owed by fixture types whose suite has been set up
+inline std::vector<void (*)()>& suite_teardowns()
+{
+    static std::vector<void (*)()> teardowns;
+    return teardowns;
+}
+
+inline std::mutex& suite_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Free a fixture type's pooled instances, then tear down its suite. Like
+// set_up_suite(), not static, so every translation unit shares one instance.
+template <typename Fixture>
+inline void tear_down_suite()
+{
+    fixture_pool<Fixture>::get().clear();
+    Fixture::TearDownSuite();
+}
+
+// Set up a fixture type's suite the first time one of its tests runs. If
+// SetUpSuite() fails, the next test of the type tries again. Not static, so
+// the once flag is shared by every translation unit using the fixture.
+template <typename Fixture>
+inline void set_up_suite()
+{
+    static std::once_flag once;
+    untracked_allocs untracked;
+    std::call_once(once, []() {
+        Fixture::SetUpSuite();
+        std::lock_guard<std::mutex> lock(suite_mutex());
+        suite_teardowns().push_back(&tear_down_suite<Fixture>);
+    });
+}
+
+// Tear down every suite that was set up, latest first
+static inline void tear_down_suites()
+{
+    std::vector<void (*)()> teardowns;
+    {
+        std::lock_guard<std::mutex> lock(suite_mutex());
+        teardowns.swap(suite_teardowns());
+    }
+    for (auto it = teardowns.rbegin(); it != teardowns.rend(); ++it)
+    {
+        (*it)();
+    }
+}
+
+// Run a TEST_F() body with a pooled fixture. TearDown() runs however SetUp()
+// or the body ends, and the body is skipped if SetUp() records a failure.
+template <typename Fixture>
+static inline void run_with_fixture(void (*body)(Fixture&))
+{
+    set_up_suite<Fixture>();
+
+    // Whether an instance is built depends on the pool, not the test
+    fixture_pool<Fixture>& pool = fixture_pool<Fixture>::get();
+    std::unique_ptr<Fixture> instance;
+    {
+        untracked_allocs untracked;
+        instance = pool.acquire();
+    }
+
+#if CCUT_NO_EXCEPTIONS
+    instance->SetUp();
+    if (!current_failure().failed)
+        body(*instance);
+    instance->TearDown();
+#else
+    try
+    {
+        instance->SetUp();
+        if (!current_failure().failed)
+            body(*instance);
+    }
+    catch (...)
+    {
+        instance->TearDown();
+        pool.release(std::move(instance));
+        throw;
+    }
+    instance->TearDown();
+#endif
+
+    pool.release(std::move(instance));
+}
+
+//              //
+// Golden Files //
+//              //
+
+// Whether golden file checks rewrite the files that don't match instead of
+// failing, as --update-golden asks
+inline bool& golden_update()
+{
+    static bool update = false;
+    return update;
+}
+
+// A whole file, mapped read-only where it can be, or else read into memory
+class mapped_file
+{
+public:
+    inline mapped_file() = default;
+
+    inline ~mapped_file()
+    {
+#if CCUT_POSIX
+        if (mapped)
+            ::munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    // Map a file, returning false with errno set if it can't be opened
+    inline bool open(const char* path)
+    {
+#if CCUT_POSIX
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        bool ok = ::fstat(fd, &info) == 0;
+        if (ok && info.st_size > 0)
+        {
+            length = static_cast<size_t>(info.st_size);
+            void* addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = addr != MAP_FAILED;
+            if (ok)
+            {
+                // Comparisons read the file once from start to end
+                ::posix_madvise(addr, length, POSIX_MADV_SEQUENTIAL);
+                bytes = static_cast<const unsigned char*>(addr);
+                mapped = true;
+            }
+        }
+        int saved_errno = errno;
+        ::close(fd);
+        errno = saved_errno;
+        return ok;
+#else
+        std::FILE* file = std::fopen(path, "rb");
+        if (!file)
+            return false;
+        char chunk[65536];
+        for (size_t got; (got = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+        {
+            contents.append(chunk, got);
+        }
+        bool ok = !std::ferror(file);
+        std::fclose(file);
+        bytes = reinterpret_cast<const unsigned char*>(contents.data());
+        length = contents.size();
+        return ok;
+#endif
+    }
+
+    inline const unsigned char* data() const
+    {
+        return bytes;
+    }
+
+    inline size_t size() const
+    {
+        return length;
+    }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#if CCUT_POSIX
+    bool mapped = false;
+#else
+    std::string contents;
+#endif
+};
+
+// Replace a file with new contents in one step, so that parallel tests
+// reading it see either the old contents or the new ones, never a mix. The
+// contents are written to a temporary file of the writer's own beside it,
+// which is then renamed over it.
+static inline bool replace_file(const char* path, const void* data, size_t size)
+{
+    static std::atomic<unsigned> written{0};
+    std::ostringstream temp;
+    temp << path << ".tmp.";
+#if CCUT_POSIX
+    temp << ::getpid() << '.';
+#endif
+    temp << std::hash<std::thread::id>()(std::this_thread::get_id()) << '.' << written++;
+    std::string temp_path = temp.str();
+
+    std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = std::fwrite(data, 1, size, file) == size;
+    ok = std::fclose(file) == 0 && ok;
+#if !CCUT_POSIX
+    std::remove(path);
+#endif
+    if (!ok || std::rename(temp_path.c_str(), path) != 0)
+    {
+        int saved_errno = errno;
+        std::remove(temp_path.c_str());
+        errno = saved_errno;
+        return false;
+    }
+    return true;
+}
+
+//            //
+// Benchmarks //
+//            //
+
+// Keep the compiler from optimizing away a value the benchmark computed
+template <typename T>
+static inline void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// Keep the compiler from assuming memory is unchanged across this point
+static inline void clobber_memory()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// Measurements from one benchmark
+struct bench_result
+{
+    bool ok = true;
+    std::string reason;
+    int line = 0;                   // Line of the failed assertion, if there was one
+    uint64_t iterations = 0;        // Calls to the body per sample
+    std::vector<double> samples_ns; // Mean time per call in each sample
+    double mean_ns = 0;
+    double stddev_ns = 0;
+    counter_values counters = {}; // Counts of each of hw_events() over all samples
+};
+
+// Time a batch of calls to a benchmark body
+static inline uint64_t time_bench_batch(bench_func_t func, uint64_t iterations)
+{
+    uint64_t start = wall_now_ns();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        func();
+    }
+    return wall_now_ns() - start;
+}
+
+// Run one benchmark. After any warmup, the iteration count doubles until a
+// batch fills its share of the target time, then that many iterations are
+// timed for every sample.
+static inline void run_benchmark(bench_func_t func, uint64_t target_ns, unsigned samples, uint64_t warmup_ns,
+                                 bench_result& result)
+{
+    failure_slot& slot = current_failure();
+    slot = failure_slot();
+    test_context context;
+    bind_thread binding(&context, true, true);
+
+    auto measure = [&]() {
+        // Let caches, branch predictors and the clock speed settle. Batches
+        // double, so this runs for at most about twice the warmup.
+        uint64_t warmed_ns = 0;
+        for (uint64_t iterations = 1; warmed_ns < warmup_ns && !slot.failed; iterations *= 2)
+        {
+            warmed_ns += time_bench_batch(func, iterations);
+        }
+
+        uint64_t sample_target_ns = std::max<uint64_t>(target_ns / samples, 1);
+
+        uint64_t iterations = 1;
+        while (iterations < (uint64_t(1) << 40))
+        {
+            uint64_t elapsed = time_bench_batch(func, iterations);
+            if (elapsed >= sample_target_ns || slot.failed)
+                break;
+
+            // Jump close to the target once the batch is long enough to trust
+            if (elapsed > 10000)
+                iterations = std::max(iterations * 2, static_cast<uint64_t>(iterations * 1.2 * sample_target_ns / elapsed));
+            else
+                iterations *= 2;
+        }
+        result.iterations = iterations;
+
+        counter_group& counters = thread_counters();
+        result.samples_ns.reserve(samples);
+        for (unsigned i = 0; i < samples && !slot.failed; i++)
+        {
+            counter_values counts = {};
+            counters.start();
+            uint64_t elapsed = time_bench_batch(func, iterations);
+            counters.stop(counts);
+            result.samples_ns.push_back(static_cast<double>(elapsed) / iterations);
+            for (size_t c = 0; c < counts.size(); c++)
+            {
+                result.counters[c] += counts[c];
+            }
+        }
+        if (slot.failed)
+            return;
+
+        double sum = 0;
+        for (double sample : result.samples_ns)
+        {
+            sum += sample;
+        }
+        result.mean_ns = sum / samples;
+
+        double sq_sum = 0;
+        for (double sample : result.samples_ns)
+        {
+            sq_sum += (sample - result.mean_ns) * (sample - result.mean_ns);
+        }
+        result.stddev_ns = samples > 1 ? std::sqrt(sq_sum / (samples - 1)) : 0;
+    };
+
+#if CCUT_NO_EXCEPTIONS
+    measure();
+#else
+    try
+    {
+        measure();
+    }
+    catch (const ccut_exception& ce)
+    {
+        record_failure(ce.get_reason(), ce.get_line());
+    }
+    catch (const std::exception& e)
+    {
+        result.ok = false;
+        result.reason = std::string("Unexpected std::exception: \"") + e.what() + '"';
+    }
+    catch (...)
+    {
+        result.ok = false;
+        result.reason = "Totally unknown error was thrown!";
+    }
+#endif
+
+    take_thread_failures(context, slot);
+    if (slot.failed)
+    {
+        result.ok = false;
+        result.reason = std::move(slot.reason);
+        result.line = slot.line;
+    }
+}
+
+// Every sample of each benchmark in a run, kept for comparing runs. The file
+// holds one line per sample, in the same form as a baseline's lines,
+//     sample <tab> nanoseconds per call <tab> name
+class bench_samples
+{
+public:
+    struct series
+    {
+        std::string name;
+        std::vector<double> ns;
+    };
+
+    inline void add(const char* name, const std::vector<double>& ns)
+    {
+        benches.push_back({name, ns});
+    }
+
+    // Read a samples file, returning false if it is missing or malformed
+    inline bool load(const std::string& path)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "r");
+        if (!file)
+            return false;
+
+        std::vector<std::pair<std::string, double>> read;
+        char line[4096];
+        bool ok = true;
+        while (ok && std::fgets(line, sizeof(line), file))
+        {
+            char* kind_end = std::strchr(line, '\t');
+            char* ns_end = nullptr;
+            double ns = kind_end ? std::strtod(kind_end + 1, &ns_end) : 0;
+            size_t kind_len = kind_end ? static_cast<size_t>(kind_end - line) : 0;
+            if (!kind_end || kind_len != std::strlen("sample") || std::strncmp(line, "sample", kind_len)
+                || ns_end == kind_end + 1 || *ns_end != '\t')
+            {
+                ok = false;
+                break;
+            }
+
+            std::string name(ns_end + 1);
+            while (!name.empty() && (name.back() == '\n' || name.back() == '\r'))
+            {
+                name.pop_back();
+            }
+            read.push_back({std::move(name), ns});
+        }
+        ok = ok && !std::ferror(file);
+        std::fclose(file);
+
+        std::stable_sort(read.begin(), read.end(),
+                         [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) {
+                             return a.first < b.first;
+                         });
+        for (const std::pair<std::string, double>& sample : read)
+        {
+            if (benches.empty() || benches.back().name != sample.first)
+                benches.push_back({sample.first, {}});
+            benches.back().ns.push_back(sample.second);
+        }
+        return ok;
+    }
+
+    // Write every benchmark's samples, replacing the file
+    inline bool save(const std::string& path) const
+    {
+        std::unique_ptr<out_buffer> file = out_buffer::open(path.c_str());
+        if (!file)
+            return false;
+
+        for (const series& bench : benches)
+        {
+            for (double ns : bench.ns)
+            {
+                *file << "sample\t";
+                file->fixed(ns, 3);
+                *file << '\t' << bench.name << '\n';
+            }
+        }
+        file->flush();
+        return true;
+    }
+
+    std::vector<series> benches; // Sorted by name once loaded
+};
+
+// Two-sided p-value of a Mann-Whitney U test of whether two sets of samples
+// come from the same distribution, by the normal approximation with
+// corrections for ties and continuity. Only the ranks of the samples count,
+// so a single outlier can neither hide a difference nor fake one.
+static inline double mann_whitney_p(const std::vector<double>& a, const std::vector<double>& b)
+{
+    double n1 = static_cast<double>(a.size());
+    double n2 = static_cast<double>(b.size());
+    double n = n1 + n2;
+    if (!n1 || !n2)
+        return 1;
+
+    // Each sample, and whether it came from a
+    std::vector<std::pair<double, bool>> all;
+    all.reserve(a.size() + b.size());
+    for (double value : a)
+    {
+        all.push_back({value, true});
+    }
+    for (double value : b)
+    {
+        all.push_back({value, false});
+    }
+    std::sort(all.begin(), all.end());
+
+    // Tied samples share the mean of the ranks they span
+    double rank_sum = 0;
+    double tie_sum = 0;
+    for (size_t begin = 0, end; begin < all.size(); begin = end)
+    {
+        for (end = begin; end < all.size() && all[end].first == all[begin].first; end++)
+        {}
+        double rank = (begin + 1 + end) / 2.0;
+        for (size_t i = begin; i < end; i++)
+        {
+            if (all[i].second)
+                rank_sum += rank;
+        }
+        double tied = static_cast<double>(end - begin);
+        tie_sum += tied * tied * tied - tied;
+    }
+
+    double u = rank_sum - n1 * (n1 + 1) / 2;
+    double variance = n1 * n2 / 12 * ((n + 1) - tie_sum / (n * (n - 1)));
+    if (variance <= 0)
+        return 1;
+    double z = std::max(std::fabs(u - n1 * n2 / 2) - 0.5, 0.0) / std::sqrt(variance);
+    return std::erfc(z / std::sqrt(2.0));
+}
+
+// Differences between runs with a p-value below this are reported as real
+static constexpr double bench_significance = 0.05;
+
+static inline double median_of(std::vector<double> values)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+// Compare the median time per call of every benchmark in two samples files.
+// Returns 1 if a benchmark got significantly slower or a file can't be read.
+static inline int compare_benchmarks(const std::string& old_path, const std::string& new_path)
+{
+    bench_samples before;
+    bench_samples after;
+    for (const std::string* path : {&old_path, &new_path})
+    {
+        if (!(path == &old_path ? before : after).load(*path))
+        {
+            std::cerr << "Could not read benchmark samples \"" << *path << "\"\n";
+            return 1;
+        }
+    }
+
+    size_t max_name_len = 0;
+    for (const bench_samples* run : {&before, &after})
+    {
+        for (const bench_samples::series& bench : run->benches)
+        {
+            max_name_len = std::max(bench.name.size(), max_name_len);
+        }
+    }
+
+    out() << "- - - Benchmark Comparison - - -\n";
+    size_t slower = 0;
+    size_t faster = 0;
+    auto old_it = before.benches.begin();
+    auto new_it = after.benches.begin();
+    while (old_it != before.benches.end() || new_it != after.benches.end())
+    {
+        bool has_old = old_it != before.benches.end() && (new_it == after.benches.end() || old_it->name <= new_it->name);
+        bool has_new = new_it != after.benches.end() && (old_it == before.benches.end() || new_it->name <= old_it->name);
+        const std::string& name = has_old ? old_it->name : new_it->name;
+        out() << "Benchmark \"" << name << "\"";
+        out().pad(max_name_len - name.size()) << " . . . ";
+
+        if (!has_old || !has_new)
+        {
+            out() << "only in " << (has_old ? old_path : new_path) << "\n";
+            (has_old ? ++old_it : ++new_it);
+            continue;
+        }
+
+        double old_ns = median_of(old_it->ns);
+        double new_ns = median_of(new_it->ns);
+        double p = mann_whitney_p(old_it->ns, new_it->ns);
+
+        std::ostringstream change;
+        change.setf(std::ios::fixed);
+        change.precision(1);
+        change << std::showpos << 100 * (new_ns / std::max(old_ns, 1e-9) - 1) << "%" << std::noshowpos;
+        change.precision(3);
+        if (p < 0.001)
+            change << ", p < 0.001";
+        else
+            change << ", p = " << p;
+
+        out() << format_op_time(old_ns) << "/op -> " << colors::bold << format_op_time(new_ns) << "/op"
+              << colors::none << " (" << change.str() << ") ";
+        if (p >= bench_significance)
+            out() << "no significant change";
+        else if (new_ns > old_ns)
+            out() << colors::red << "SLOWER" << colors::none;
+        else
+            out() << colors::green << "FASTER" << colors::none;
+        out() << "\n";
+
+        if (p < bench_significance)
+            (new_ns > old_ns ? slower : faster)++;
+        ++old_it;
+        ++new_it;
+    }
+
+    out() << "\nSignificantly slower: " << slower << ", faster: " << faster << "\n";
+    out().flush();
+    return slower ? 1 : 0;
+}
+
+// Pins the calling thread to one CPU for the pin's lifetime, then lets it
+// run on the CPUs it could before
+class cpu_pin
+{
+public:
+    inline explicit cpu_pin(int cpu)
+    {
+#if defined(__linux__)
+        if (cpu < 0)
+            return;
+        cpu_set_t wanted;
+        CPU_ZERO(&wanted);
+        CPU_SET(cpu, &wanted);
+        pinned = ::sched_getaffinity(0, sizeof(saved), &saved) == 0 && ::sched_setaffinity(0, sizeof(wanted), &wanted) == 0;
+        if (!pinned)
+            std::cerr << "Could not pin benchmarks to CPU " << cpu << " (" << std::strerror(errno)
+                      << "); running them unpinned\n";
+#else
+        (void)cpu;
+#endif
+    }
+
+    inline ~cpu_pin()
+    {
+#if defined(__linux__)
+        if (pinned)
+            ::sched_setaffinity(0, sizeof(saved), &saved);
+#endif
+    }
+
+    cpu_pin(const cpu_pin&) = delete;
+    cpu_pin& operator=(const cpu_pin&) = delete;
+
+private:
+#if defined(__linux__)
+    cpu_set_t saved;
+    bool pinned = false;
+#endif
+};
+
+// Run all benchmarks in order on the calling thread, returning whether all of
+// them worked and none regressed against the baseline, if there is one
+static inline bool run_benchmarks(const options& opts, baseline* timings)
+{
+    bool all_ok = true;
+    std::vector<const RegisterBenchmark*> order = sorted_nodes(bench_registry());
+    unsigned samples = opts.bench_samples;
+    bench_samples measured;
+    cpu_pin pin(opts.bench_cpu);
+
+    size_t max_name_len = 0;
+    for (const RegisterBenchmark* bench : order)
+    {
+        max_name_len = std::max(std::strlen(bench->name), max_name_len);
+    }
+
+    out() << "\n- - - Benchmarks - - -\n";
+    for (const RegisterBenchmark* bench : order)
+    {
+        size_t spaces = max_name_len - std::strlen(bench->name);
+        out() << "Running benchmark \"" << bench->name << "\"";
+        out().pad(spaces) << " . . . ";
+        out().flush();
+
+        bench_result result;
+        run_benchmark(bench->func, opts.bench_time_ns, samples, opts.bench_warmup_ns, result);
+        if (result.ok && !opts.bench_out.empty())
+            measured.add(bench->name, result.samples_ns);
+
+        if (result.ok && timings)
+        {
+            timings->record("bench", bench->name, result.mean_ns);
+            result.ok = !timings->regressed("bench", bench->name, result.mean_ns, 0, result.reason);
+        }
+
+        if (!result.ok)
+        {
+            out() << colors::red << "FAIL" << colors::none << "\n -> ";
+            if (result.line)
+                out() << "Line " << colors::bold << result.line << colors::none << ": ";
+            out() << result.reason << "\n";
+            all_ok = false;
+            continue;
+        }
+
+        std::ostringstream spread;
+        spread.setf(std::ios::fixed);
+        spread.precision(2);
+        spread << (result.mean_ns > 0 ? 100 * result.stddev_ns / result.mean_ns : 0.0) << "%";
+
+        out() << colors::bold << format_op_time(result.mean_ns) << "/op" << colors::none << " +/- "
+              << spread.str() << " (" << result.iterations << " iterations x " << samples << " samples)\n";
+        if (!hw_events().empty())
+        {
+            double per_op[max_hw_counters];
+            for (size_t i = 0; i < max_hw_counters; i++)
+            {
+                per_op[i] = static_cast<double>(result.counters[i]) / (static_cast<double>(result.iterations) * samples);
+            }
+            out() << " -> " << describe_counters(hw_events(), per_op, "/op") << "\n";
+        }
+    }
+
+    if (!opts.bench_out.empty() && !measured.save(opts.bench_out))
+        std::cerr << "Could not write benchmark samples \"" << opts.bench_out << "\": " << std::strerror(errno) << "\n";
+    return all_ok;
+}
+
+// Run the current batch of tests in the way the options ask for. Returns
+// false if a timed out test is left stuck on another thread.
+static inline bool run_batch(run_state& state, reporter_set& report, const options& opts, bool has_timeouts)
+{
+#if CCUT_HAS_FORK
+    if (opts.shards)
+    {
+        run_forked(state, report, opts.shards);
+        return true;
+    }
+#endif
+
+    // Time limits need the tests off the main thread, which watches them,
+    // and async tests run together on a thread of their own
+    bool has_async = false;
+#if CCUT_HAS_COROUTINES
+    has_async = std::any_of(state.order.begin(), state.order.end(),
+                            [](const RegisterTest* test) { return test->async && !test->serial; });
+#endif
+    if (opts.jobs > 1 || has_timeouts || has_async)
+        return run_threaded(state, report, opts.jobs);
+
+    // Run all tests, reporting each one as it runs
+    for (size_t i = 0; i < state.order.size(); i++)
+    {
+        report.test_starting(state, i);
+        run_test(state.order[i]->func, state.results[i]);
+        report.test_finished(state, i);
+        report.sync();
+        if (pass_stops_run(state, i))
+            break;
+    }
+    return true;
+}
+
+static inline void save_result_cache(result_cache& cache, const std::string& path)
+{
+    if (!cache.save(path))
+        std::cerr << "Could not write result cache \"" << path << "\": " << std::strerror(errno) << "\n";
+}
+
+// Run all tests. Returns 1 if any test failed or any benchmark failed or
+// regressed past the baseline tolerance, and 0 otherwise.
+static inline int test_main(int argc, char** argv)
+{
+    options opts;
+    if (!parse_options(argc, argv, opts))
+        return 1;
+
+    // Must happen before any stream I/O
+    if (!opts.stdio_sync)
+        std::ios_base::sync_with_stdio(false);
+
+    // Comparing saved benchmark runs doesn't run anything
+    if (!opts.bench_compare_old.empty())
+        return compare_benchmarks(opts.bench_compare_old, opts.bench_compare_new);
+
+    // Listing needs nothing but the selection, so it skips all other setup
+    if (opts.list)
+    {
+        std::string names;
+        for (const RegisterTest* test : select_tests(test_registry(), opts))
+        {
+            names.append(test->name).push_back('\n');
+        }
+        std::cout.write(names.data(), static_cast<std::streamsize>(names.size())).flush();
+        return 0;
+    }
+
+    reporter_set report;
+    if (!make_reporters(opts, report))
+        return 1;
+
+    std::unique_ptr<baseline> timings;
+    if (!opts.baseline.empty())
+    {
+        timings.reset(new baseline(opts.baseline_tolerance));
+        if (!timings->load(opts.baseline))
+        {
+            std::cerr << "Could not read baseline \"" << opts.baseline << "\"\n";
+            return 1;
+        }
+        report.use_baseline(timings.get());
+    }
+
+    // Counters are optional, so a machine without them still runs the tests
+    if (!opts.counters.empty())
+    {
+        counter_group probe;
+        std::string error;
+        if (probe.open(opts.counters, error))
+            hw_events() = opts.counters;
+        else
+            std::cerr << "Hardware counters unavailable (" << error << "); running without them\n";
+    }
+
+    golden_update() = opts.update_golden;
+
+    uint64_t run_start = wall_now_ns();
+
+    // Flatten the registry so tests can be referred to by index
+    run_state state;
+    state.registered = test_registry().size;
+    std::vector<const RegisterTest*> selected = select_tests(test_registry(), opts);
+
+    std::unique_ptr<result_cache> cache;
+    if (!opts.result_cache.empty())
+    {
+        cache.reset(new result_cache());
+        cache->load(opts.result_cache);
+    }
+
+    // Nodes split the whole selection, before any narrowing to failures,
+    // so that they all start from the same tests
+    if (opts.nodes > 1)
+        selected = select_node(selected, expected_durations(selected, timings.get(), cache.get()), opts.node, opts.nodes);
+
+    if (cache)
+    {
+        cache->plan(selected, opts.rerun_failed, !opts.shuffle);
+        report.use_cache(cache.get());
+    }
+    state.selected = selected.size();
+    std::vector<uint64_t> expected = expected_durations(selected, timings.get(), cache.get());
+
+    std::vector<uint64_t> timeouts(selected.size());
+    bool has_timeouts = false;
+    for (size_t i = 0; i < selected.size(); i++)
+    {
+        const RegisterTest* test = selected[i];
+        state.max_name_len = std::max(std::strlen(test->name), state.max_name_len);
+        if (!test_timeout(test, opts.timeout_ns, timeouts[i]))
+        {
+            std::cerr << "Invalid timeout tag on test \"" << test->name << "\"\n";
+            return 1;
+        }
+        has_timeouts = has_timeouts || timeouts[i];
+    }
+
+    // Repeated runs go in batches of whole passes, so memory stays bounded
+    // and workers are started once per batch rather than once per pass.
+    // Under --until-fail a batch stops at the end of the first pass with a
+    // failure, and batches are kept just big enough to keep every worker
+    // busy, so few tests of later passes are started by then.
+    size_t passes_per_batch = 1;
+    if (!selected.empty())
+    {
+        size_t wanted = 4096;
+        if (opts.until_fail)
+            wanted = std::max(opts.jobs, opts.shards) * 16;
+        passes_per_batch = std::max<size_t>(std::min<size_t>(wanted, 4096) / selected.size(), 1);
+    }
+    if (opts.repeat)
+        passes_per_batch = std::min<size_t>(passes_per_batch, opts.repeat);
+
+    state.planned = opts.repeat * selected.size();
+    state.track_allocs = alloc_tracking();
+    state.counters = hw_events();
+    state.shuffled = opts.shuffle;
+    state.seed = opts.seed;
+    state.until_fail = opts.until_fail;
+    state.repetitions = 0;
+
+    std::mt19937_64 rng(opts.seed);
+    std::vector<size_t> pass_order(selected.size());
+    for (size_t i = 0; i < pass_order.size(); i++)
+    {
+        pass_order[i] = i;
+    }
+
+    report.run_starting(state);
+
+    for (;;)
+    {
+        size_t passes = passes_per_batch;
+        if (opts.repeat)
+            passes = std::min<size_t>(passes, opts.repeat - state.repetitions);
+        if (!passes)
+            break;
+
+        // Each pass gets its own order when shuffling
+        state.order.clear();
+        state.timeouts.clear();
+        state.expected.clear();
+        for (size_t pass = 0; pass < passes; pass++)
+        {
+            if (opts.shuffle)
+                std::shuffle(pass_order.begin(), pass_order.end(), rng);
+            for (size_t i : pass_order)
+            {
+                state.order.push_back(selected[i]);
+                state.timeouts.push_back(timeouts[i]);
+                state.expected.push_back(expected[i]);
+            }
+        }
+        state.results.assign(state.order.size(), test_result());
+        state.repetitions += static_cast<unsigned>(passes);
+
+        size_t reported_before = state.reported;
+        bool finished = run_batch(state, report, opts, has_timeouts);
+
+        // Only count the passes that ran, if --until-fail cut the batch short
+        size_t ran = state.reported - reported_before;
+        if (ran < state.order.size())
+            state.repetitions -= static_cast<unsigned>(passes - (ran + state.selected - 1) / state.selected);
+
+        if (!finished)
+        {
+            // A test is still stuck on another thread, so don't wait for it
+            report.run_finished(state, wall_now_ns() - run_start);
+            report.flush();
+            if (cache)
+                save_result_cache(*cache, opts.result_cache);
+            std::_Exit(1);
+        }
+        state.first += ran;
+
+        if (selected.empty() || (opts.until_fail && state.passed != state.reported))
+            break;
+    }
+
+    tear_down_suites();
+
+    report.run_finished(state, wall_now_ns() - run_start);
+
+    bool benches_ok = true;
+    if (opts.bench && bench_registry().size)
+        benches_ok = run_benchmarks(opts, timings.get());
+
+    report.flush();
+
+    if (cache)
+        save_result_cache(*cache, opts.result_cache);
+
+    // Only a passing run is worth comparing later runs against
+    bool run_ok = state.passed == state.reported && benches_ok;
+    if (timings && (!timings->exists() || opts.update_baseline))
+    {
+        if (!run_ok)
+            std::cerr << "Baseline \"" << opts.baseline << "\" not written, since the run had failures\n";
+        else if (!timings->save(opts.baseline))
+            std::cerr << "Could not write baseline \"" << opts.baseline << "\": " << std::strerror(errno) << "\n";
+    }
+    return run_ok ? 0 : 1;
+}
+
+// Run all tests with default options
+static inline int test_main()
+{
+    return test_main(0, nullptr);
+}
+
+//                  //
+// Value Formatting //
+//                  //
+
+// Limits on how much of one operand a failure message shows
+static constexpr size_t format_max_elements = 8;
+static constexpr size_t format_max_chars = 256;
+
+// How a value is shown in failure messages. The default streams values that
+// support operator<<, lists the elements of ranges, and shows the bytes of
+// anything else. Specialize it to show a type differently:
+//
+//     template <>
+//     struct ccut_framework::formatter<my_type>
+//     {
+//         static void format(std::ostream& os, const my_type& value);
+//     };
+template <typename T, typename Enable = void>
+struct formatter;
+
+// Show any value through its formatter
+template <typename T>
+static inline void format_value(std::ostream& os, const T& value)
+{
+    formatter<T>::format(os, value);
+}
+
+// Overload ranks for picking the default format; higher ranks win
+template <unsigned N>
+struct format_rank : format_rank<N - 1>
+{};
+
+template <>
+struct format_rank<0>
+{};
+
+template <typename Range>
+static inline void format_range(std::ostream& os, const Range& range)
+{
+    os << '[';
+    size_t count = 0;
+    for (auto it = std::begin(range), end = std::end(range); it != end; ++it, ++count)
+    {
+        if (count == format_max_elements)
+        {
+            size_t rest = 0;
+            for (; it != end; ++it)
+            {
+                rest++;
+            }
+            os << ", ... +" << rest << " more";
+            break;
+        }
+        if (count)
+            os << ", ";
+        format_value(os, *it);
+    }
+    os << ']';
+}
+
+// Values that can be streamed
+template <typename T>
+static inline auto format_default(std::ostream& os, const T& value, format_rank<2>) -> decltype(void(os << value))
+{
+    os << value;
+}
+
+// Ranges, by their first few elements
+template <typename T>
+static inline auto format_default(std::ostream& os, const T& value, format_rank<1>)
+    -> decltype(void(std::begin(value)), void(std::end(value)))
+{
+    format_range(os, value);
+}
+
+static inline void format_bytes(std::ostream& os, const void* data, size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    os << '{' << size << "-byte object <";
+    for (size_t i = 0; i < size && i < format_max_chars / 4; i++)
+    {
+        if (i)
+            os << ' ';
+        os << hex[bytes[i] >> 4] << hex[bytes[i] & 0xf];
+    }
+    if (size > format_max_chars / 4)
+        os << " ...";
+    os << ">}";
+}
+
+// Anything else, by its bytes
+template <typename T>
+static inline void format_default(std::ostream& os, const T& value, format_rank<0>)
+{
+    format_bytes(os, &value, sizeof(T));
+}
+
+template <typename T, typename Enable>
+struct formatter
+{
+    static inline void format(std::ostream& os, const T& value)
+    {
+        format_default(os, value, format_rank<2>());
+    }
+};
+
+// Strings are quoted and cut short
+static inline void format_string(std::ostream& os, const char* str, size_t len)
+{
+    os << '"';
+    os.write(str, static_cast<std::streamsize>(std::min(len, format_max_chars)));
+    os << '"';
+    if (len > format_max_chars)
+        os << "... +" << len - format_max_chars << " more chars";
+}
+
+template <>
+struct formatter<std::string>
+{
+    static inline void format(std::ostream& os, const std::string& value)
+    {
+        format_string(os, value.data(), value.size());
+    }
+};
+
+template <>
+struct formatter<std::string_view>
+{
+    static inline void format(std::ostream& os, std::string_view value)
+    {
+        format_string(os, value.data(), value.size());
+    }
+};
+
+template <>
+struct formatter<const char*>
+{
+    static inline void format(std::ostream& os, const char* value)
+    {
+        if (value)
+            format_string(os, value, std::strlen(value));
+        else
+            os << "nullptr";
+    }
+};
+
+template <>
+struct formatter<char*> : formatter<const char*>
+{};
+
+template <size_t N>
+struct formatter<char[N]>
+{
+    static inline void format(std::ostream& os, const char (&value)[N])
+    {
+        format_string(os, value, strnlen(value, N));
+    }
+};
+
+template <>
+struct formatter<bool>
+{
+    static inline void format(std::ostream& os, bool value)
+    {
+        os << (value ? "true" : "false");
+    }
+};
+
+template <>
+struct formatter<char>
+{
+    static inline void format(std::ostream& os, char value)
+    {
+        os << '\'' << value << "' (" << static_cast<int>(value) << ')';
+    }
+};
+
+// Floating point values with enough digits to tell close values apart
+template <typename T>
+struct formatter<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static inline void format(std::ostream& os, T value)
+    {
+        std::streamsize precision = os.precision(std::numeric_limits<T>::max_digits10);
+        os << value;
+        os.precision(precision);
+    }
+};
+
+template <typename A, typename B>
+struct formatter<std::pair<A, B>>
+{
+    static inline void format(std::ostream& os, const std::pair<A, B>& value)
+    {
+        os << '(';
+        format_value(os, value.first);
+        os << ", ";
+        format_value(os, value.second);
+        os << ')';
+    }
+};
+
+// Render a value for a failure message
+template <typename T>
+static inline std::string describe_value(const T& value)
+{
+    std::ostringstream os;
+    format_value(os, value);
+    return os.str();
+}
+
+// Explain where two ranges with comparable elements first differ
+template <typename T1, typename T2>
+static inline auto describe_difference(const T1& lhs, const T2& rhs, format_rank<1>)
+    -> decltype(void(*std::begin(lhs) == *std::begin(rhs)), void(std::end(lhs)), void(std::end(rhs)), std::string())
+{
+    auto lit = std::begin(lhs);
+    auto lend = std::end(lhs);
+    auto rit = std::begin(rhs);
+    auto rend = std::end(rhs);
+
+    size_t index = 0;
+    for (; lit != lend && rit != rend; ++lit, ++rit, ++index)
+    {
+        if (!(*lit == *rit))
+        {
+            std::ostringstream os;
+            os << "first difference at index " << index << ": ";
+            format_value(os, *lit);
+            os << " vs ";
+            format_value(os, *rit);
+            return os.str();
+        }
+    }
+
+    if (lit == lend && rit == rend)
+        return std::string();
+
+    // One is a prefix of the other
+    size_t lsize = index;
+    size_t rsize = index;
+    for (; lit != lend; ++lit)
+    {
+        lsize++;
+    }
+    for (; rit != rend; ++rit)
+    {
+        rsize++;
+    }
+
+    std::ostringstream os;
+    os << "sizes differ: " << lsize << " vs " << rsize << ", equal up to index " << index;
+    return os.str();
+}
+
+template <typename T1, typename T2>
+static inline std::string describe_difference(const T1&, const T2&, format_rank<0>)
+{
+    return std::string();
+}
+
+//                     //
+// Assertion Functions //
+//                     //
+
+// Hand a failure to the running test. A fatal failure ends the test, either
+// by throwing or, in builds without exceptions, by the ASSERT_* macro
+// returning once it has been recorded. Any thread may report; see
+// test_thread for how failures on other threads reach the test.
+CCUT_COLD static inline void report_failure(std::string reason, int line, bool fatal)
+{
+    untracked_allocs untracked;
+#if !CCUT_NO_EXCEPTIONS
+    // The test's own thread records what it catches; other threads record
+    // first, and only throw where a test_thread will catch it
+    const thread_binding& binding = current_binding();
+    if (fatal && binding.own)
+    {
+        binding.context->cancelled.store(true, std::memory_order_relaxed);
+        throw ccut_exception(std::move(reason), line);
+    }
+    if (fatal && binding.catches)
+    {
+        record_failure(reason, line);
+        throw ccut_exception(std::move(reason), line);
+    }
+#else
+    (void)fatal;
+#endif
+    record_failure(std::move(reason), line);
+}
+
+// Failure paths. These are the only places that build strings, so a passing
+// assertion never allocates or touches the stringized expressions.
+
+CCUT_COLD static inline void fail_boolean(bool expected, const char* str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    os << "Expected " << (expected ? "TRUE" : "FALSE") << ", but was " << (expected ? "FALSE" : "TRUE")
+       << ": \"" << str << '"';
+    report_failure(os.str(), line, fatal);
+}
+
+CCUT_COLD static inline void fail_comparison(const char* kind, const char* lhs_str, const char* rhs_str,
+                                             const std::string& lhs_value, const std::string& rhs_value,
+                                             const std::string& difference, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    os << "Expected " << kind << ", but was NOT " << kind << ": [" << lhs_str << "]"
+       << " and [" << rhs_str << "]";
+
+    // The values only add something when the expressions weren't literals
+    if (lhs_value != lhs_str || rhs_value != rhs_str)
+    {
+        os << " (" << lhs_value << " vs " << rhs_value;
+        if (!difference.empty())
+            os << "; " << difference;
+        os << ')';
+    }
+    report_failure(os.str(), line, fatal);
+}
+
+// Capture the operands of a failed comparison. Cold and out of line, and
+// only called once a comparison has failed, so formatting the operands costs
+// passing checks nothing but the call site.
+template <typename T1, typename T2>
+CCUT_COLD static inline void fail_values(const char* kind, const T1& lhs, const T2& rhs,
+                                         const char* lhs_str, const char* rhs_str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    fail_comparison(kind, lhs_str, rhs_str, describe_value(lhs), describe_value(rhs),
+                    describe_difference(lhs, rhs, format_rank<1>()), line, fatal);
+}
+
+CCUT_COLD static inline void fail_exception(bool expected, const char* str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    os << (expected ? "Expected EXCEPTION, but got NO EXCEPTION: \"" : "Expected NO EXCEPTION, but got EXCEPTION: \"")
+       << str << '"';
+    report_failure(os.str(), line, fatal);
+}
+
+// Format a floating point operand at the precision of the type it was compared as
+CCUT_COLD static inline void format_float(std::ostream& os, long double value, size_t float_size)
+{
+    if (float_size == sizeof(float))
+        format_value(os, static_cast<float>(value));
+    else if (float_size == sizeof(double))
+        format_value(os, static_cast<double>(value));
+    else
+        format_value(os, value);
+}
+
+CCUT_COLD static inline void fail_near(float_measure measure, long double lhs, long double rhs, size_t float_size,
+                                       long double found, const char* lhs_str, const char* rhs_str,
+                                       const char* limit_str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    static const char* const kinds[] = {"NEAR", "NEAR REL", "NEAR ULP"};
+    const char* kind = kinds[static_cast<size_t>(measure)];
+
+    std::ostringstream os;
+    os << "Expected " << kind << ", but was NOT " << kind << ": [" << lhs_str << "] and [" << rhs_str << "] (";
+    format_float(os, lhs, float_size);
+    os << " vs ";
+    format_float(os, rhs, float_size);
+    switch (measure)
+    {
+    case float_measure::absolute:
+        os << "; difference ";
+        format_float(os, found, float_size);
+        os << " > tolerance [" << limit_str << ']';
+        break;
+    case float_measure::relative:
+        os << "; relative difference ";
+        format_float(os, found, float_size);
+        os << " > tolerance [" << limit_str << ']';
+        break;
+    case float_measure::ulps:
+        if (lhs != lhs || rhs != rhs)
+            os << "; NaN is no number of ULPs from anything";
+        else
+            os << "; " << static_cast<uint64_t>(found) << " ULPs apart > [" << limit_str << ']';
+        break;
+    }
+    os << ')';
+    report_failure(os.str(), line, fatal);
+}
+
+CCUT_COLD static inline void fail_array_near(long double lhs, long double rhs, size_t float_size, size_t index,
+                                             size_t far, size_t count, const char* lhs_str,
+                                             const char* rhs_str, const char* limit_str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    os << "Expected ARRAY NEAR, but was NOT ARRAY NEAR: [" << lhs_str << "] and [" << rhs_str << "] (" << far
+       << " of " << count << " elements differ by more than [" << limit_str << "]; first at index " << index
+       << ": ";
+    format_float(os, lhs, float_size);
+    os << " vs ";
+    format_float(os, rhs, float_size);
+    os << ')';
+    report_failure(os.str(), line, fatal);
+}
+
+// Bytes shown either side of the first difference between two blocks
+static constexpr size_t byte_context = 8;
+
+// Write the bytes of [first, last) in hex, marking the one at offset
+static inline void write_byte_window(std::ostream& os, const void* data, size_t first, size_t last, size_t offset)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = first; i < last; i++)
+    {
+        if (i != first)
+            os << ' ';
+        if (i == offset)
+            os << '>';
+        os << hex[bytes[i] >> 4] << hex[bytes[i] & 0xf];
+        if (i == offset)
+            os << '<';
+    }
+}
+
+CCUT_COLD static inline void fail_bytes(const void* lhs, const void* rhs, size_t size, size_t offset,
+                                        const char* lhs_str, const char* rhs_str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    size_t first = offset > byte_context ? offset - byte_context : 0;
+    size_t last = size - offset > byte_context ? offset + byte_context : size;
+
+    std::ostringstream os;
+    os << "Expected BYTES EQUAL, but was NOT BYTES EQUAL: [" << lhs_str << "] and [" << rhs_str
+       << "] (first difference at offset " << offset << " (0x" << std::hex << offset << std::dec << ") of " << size
+       << " bytes; bytes " << first << '-' << last - 1 << ": ";
+    write_byte_window(os, lhs, first, last, offset);
+    os << " vs ";
+    write_byte_window(os, rhs, first, last, offset);
+    os << ')';
+    report_failure(os.str(), line, fatal);
+}
+
+// Report two ranges that differ, given the elements around the difference
+CCUT_COLD static inline void fail_range(const char* kind, const range_difference& where, const std::string* lhs,
+                                        const std::string* rhs, const char* lhs_str, const char* rhs_str, int line,
+                                        bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    os << "Expected " << kind << ", but was NOT " << kind << ": [" << lhs_str << "] and [" << rhs_str << "] (";
+
+    size_t common = std::min(where.lhs_size, where.rhs_size);
+    if (where.lhs_size != where.rhs_size)
+        os << "sizes differ: " << where.lhs_size << " vs " << where.rhs_size << "; ";
+    if (where.index < common)
+        os << "first difference at index " << where.index;
+    else
+        os << "equal up to index " << where.index;
+    if (where.lhs_size == where.rhs_size)
+        os << " of " << where.lhs_size;
+
+    if (where.lhs_shown || where.rhs_shown)
+    {
+        auto window = [&](const std::string* items, size_t shown) {
+            for (size_t i = 0; i < shown; i++)
+            {
+                if (i)
+                    os << ", ";
+                if (where.first + i == where.index)
+                    os << '>' << items[i] << '<';
+                else
+                    os << items[i];
+            }
+        };
+        os << "; elements " << where.first << '-' << where.first + std::max(where.lhs_shown, where.rhs_shown) - 1
+           << ": ";
+        window(lhs, where.lhs_shown);
+        os << " vs ";
+        window(rhs, where.rhs_shown);
+    }
+    os << ')';
+    report_failure(os.str(), line, fatal);
+}
+
+template <typename It>
+CCUT_COLD static inline void describe_window(It it, size_t first, size_t shown, std::string* items)
+{
+    for (size_t i = 0; i < first; ++i)
+    {
+        ++it;
+    }
+    for (size_t i = 0; i < shown; ++i, ++it)
+    {
+        items[i] = describe_value(*it);
+    }
+}
+
+template <typename It1, typename It2>
+CCUT_COLD static inline void fail_range_values(const char* kind, const range_difference& where, It1 lhs, It2 rhs,
+                                               const char* lhs_str, const char* rhs_str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::string lhs_items[2 * range_context + 1];
+    std::string rhs_items[2 * range_context + 1];
+    describe_window(lhs, where.first, where.lhs_shown, lhs_items);
+    describe_window(rhs, where.first, where.rhs_shown, rhs_items);
+    fail_range(kind, where, lhs_items, rhs_items, lhs_str, rhs_str, line, fatal);
+}
+
+// Each check returns whether it passed. Non-fatal checks back EXPECT_*.
+
+static inline bool assert_true(bool expr, const char* str, int line, bool fatal = true)
+{
+    if (CCUT_UNLIKELY(!expr))
+    {
+        fail_boolean(true, str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+static inline bool assert_false(bool expr, const char* str, int line, bool fatal = true)
+{
+    if (CCUT_UNLIKELY(expr))
+    {
+        fail_boolean(false, str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_equal(const T1& lhs, const T2& rhs, const char* lhs_str, const char* rhs_str, int line,
+                                bool fatal = true)
+{
+    if (CCUT_UNLIKELY(!(lhs == rhs)))
+    {
+        fail_values("EQUAL", lhs, rhs, lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_unequal(const T1& lhs, const T2& rhs, const char* lhs_str, const char* rhs_str, int line,
+                                  bool fatal = true)
+{
+    if (CCUT_UNLIKELY(!(lhs != rhs)))
+    {
+        fail_values("UNEQUAL", lhs, rhs, lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+static inline bool assert_almost_equal(long double lhs, long double rhs, const char* lhs_str, const char* rhs_str,
+                                       int line, bool fatal = true)
+{
+    static constexpr long double allowable_error = 0.0001;
+    long double real_error;
+    if (CCUT_UNLIKELY(!near_absolute(lhs, rhs, allowable_error, real_error)))
+    {
+        fail_values("ALMOST EQUAL", lhs, rhs, lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_near(const T1& lhs, const T2& rhs, long double tolerance, const char* lhs_str,
+                               const char* rhs_str, const char* tolerance_str, int line, bool fatal = true)
+{
+    long double difference;
+    if (CCUT_UNLIKELY(!near_absolute(lhs, rhs, tolerance, difference)))
+    {
+        fail_near(float_measure::absolute, lhs, rhs, sizeof(float_type<T1, T2>), difference, lhs_str,
+                  rhs_str, tolerance_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_near_relative(const T1& lhs, const T2& rhs, long double tolerance, const char* lhs_str,
+                                        const char* rhs_str, const char* tolerance_str, int line, bool fatal = true)
+{
+    long double difference;
+    if (CCUT_UNLIKELY(!near_relative(lhs, rhs, tolerance, difference)))
+    {
+        fail_near(float_measure::relative, lhs, rhs, sizeof(float_type<T1, T2>), difference, lhs_str,
+                  rhs_str, tolerance_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_near_ulps(const T1& lhs, const T2& rhs, uint64_t max_ulps, const char* lhs_str,
+                                    const char* rhs_str, const char* ulps_str, int line, bool fatal = true)
+{
+    typedef float_type<T1, T2> type;
+    uint64_t distance = ulp_distance<type>(static_cast<type>(lhs), static_cast<type>(rhs));
+    if (CCUT_UNLIKELY(distance > max_ulps))
+    {
+        fail_near(float_measure::ulps, lhs, rhs, sizeof(type), static_cast<long double>(distance), lhs_str, rhs_str,
+                  ulps_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename T1, typename T2>
+static inline bool assert_array_near(const T1* lhs, const T2* rhs, size_t count, long double tolerance,
+                                     const char* lhs_str, const char* rhs_str, const char* tolerance_str, int line,
+                                     bool fatal = true)
+{
+    typedef float_type<T1, T2> type;
+    size_t far = count_far(lhs, rhs, count, static_cast<type>(tolerance));
+    if (CCUT_UNLIKELY(far != 0))
+    {
+        size_t index = first_far(lhs, rhs, count, static_cast<type>(tolerance));
+        fail_array_near(lhs[index], rhs[index], sizeof(type), index, far, count, lhs_str, rhs_str,
+                        tolerance_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+static inline bool assert_bytes_equal(const void* lhs, const void* rhs, size_t size, const char* lhs_str,
+                                      const char* rhs_str, int line, bool fatal = true)
+{
+    size_t offset = bytes_mismatch(lhs, rhs, size);
+    if (CCUT_UNLIKELY(offset != size))
+    {
+        fail_bytes(lhs, rhs, size, offset, lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename It1, typename It2>
+static inline bool assert_range_equal(It1 lhs_begin, It1 lhs_end, It2 rhs_begin, const char* lhs_str,
+                                      const char* rhs_str, int line, bool fatal = true)
+{
+    size_t size = range_size(lhs_begin, lhs_end);
+    size_t index = range_mismatch(lhs_begin, rhs_begin, size);
+    if (CCUT_UNLIKELY(index != size))
+    {
+        fail_range_values("RANGE EQUAL", locate_difference(index, size, size), lhs_begin, rhs_begin, lhs_str,
+                          rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+template <typename C1, typename C2>
+static inline bool assert_container_equal(const C1& lhs, const C2& rhs, const char* lhs_str, const char* rhs_str,
+                                          int line, bool fatal = true)
+{
+    size_t lhs_size = container_size(lhs);
+    size_t rhs_size = container_size(rhs);
+    size_t common = std::min(lhs_size, rhs_size);
+    size_t index = range_mismatch(container_begin(lhs), container_begin(rhs), common);
+    if (CCUT_UNLIKELY(index != common || lhs_size != rhs_size))
+    {
+        fail_range_values("CONTAINER EQUAL", locate_difference(index, lhs_size, rhs_size), container_begin(lhs),
+                          container_begin(rhs), lhs_str, rhs_str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+static inline bool assert_thrown(bool expected, bool threw, const char* str, int line, bool fatal = true)
+{
+    if (CCUT_UNLIKELY(threw != expected))
+    {
+        fail_exception(expected, str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+// Timing assertions take the median of this many samples, each a batch of
+// calls long enough to be well above the clock's resolution
+static constexpr unsigned timing_samples = 15;
+static constexpr uint64_t timing_sample_min_ns = 100000;
+
+// Median time per call of func, leaving out samples beyond Tukey's fences
+template <typename Func>
+static inline double median_call_ns(Func& func)
+{
+    uint64_t iterations = 1;
+    auto time_batch = [&]() {
+        uint64_t start = wall_now_ns();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            func();
+        }
+        return wall_now_ns() - start;
+    };
+
+    while (time_batch() < timing_sample_min_ns && iterations < (uint64_t(1) << 30))
+    {
+        iterations *= 2;
+    }
+
+    double samples[timing_samples];
+    for (unsigned i = 0; i < timing_samples; i++)
+    {
+        samples[i] = static_cast<double>(time_batch()) / iterations;
+    }
+    std::sort(samples, samples + timing_samples);
+
+    double q1 = samples[timing_samples / 4];
+    double q3 = samples[timing_samples * 3 / 4];
+    double* low = std::lower_bound(samples, samples + timing_samples, q1 - 1.5 * (q3 - q1));
+    double* high = std::upper_bound(samples, samples + timing_samples, q3 + 1.5 * (q3 - q1));
+    return low[(high - low) / 2];
+}
+
+template <typename Rep, typename Period>
+static inline uint64_t duration_ns(std::chrono::duration<Rep, Period> duration)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+CCUT_COLD static inline void fail_duration(const char* str, const char* budget_str, uint64_t budget_ns,
+                                           double median_ns, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    os << "Expected DURATION BELOW [" << budget_str << "] (" << format_op_time(static_cast<double>(budget_ns))
+       << "), but median was " << format_op_time(median_ns) << ": \"" << str << '"';
+    report_failure(os.str(), line, fatal);
+}
+
+CCUT_COLD static inline void fail_faster(const char* a_str, const char* b_str, const char* ratio_str, double a_ns,
+                                         double b_ns, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    os << "Expected [" << a_str << "] FASTER THAN [" << b_str << "] by [" << ratio_str << "]x, but medians were "
+       << format_op_time(a_ns) << " and " << format_op_time(b_ns);
+    os.setf(std::ios::fixed);
+    os.precision(2);
+    os << " (" << b_ns / std::max(a_ns, 1e-9) << "x)";
+    report_failure(os.str(), line, fatal);
+}
+
+// Timing checks run their expressions many times, so they are best kept to
+// serial tests; other tests running alongside make the timings noisy
+
+template <typename Func>
+static inline bool assert_duration_below(Func func, uint64_t budget_ns, const char* str, const char* budget_str,
+                                         int line, bool fatal = true)
+{
+    double median_ns = median_call_ns(func);
+    if (CCUT_UNLIKELY(median_ns >= static_cast<double>(budget_ns)))
+    {
+        fail_duration(str, budget_str, budget_ns, median_ns, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+// Check that a is at least ratio times faster than b
+template <typename FuncA, typename FuncB>
+static inline bool assert_faster_than(FuncA a, FuncB b, double ratio, const char* a_str, const char* b_str,
+                                      const char* ratio_str, int line, bool fatal = true)
+{
+    double a_ns = median_call_ns(a);
+    double b_ns = median_call_ns(b);
+    if (CCUT_UNLIKELY(a_ns * ratio > b_ns))
+    {
+        fail_faster(a_str, b_str, ratio_str, a_ns, b_ns, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+CCUT_COLD static inline void fail_allocs(uint64_t max, const char* max_str, uint64_t count, uint64_t bytes,
+                                         const char* str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    if (!alloc_tracking())
+        os << "Allocation tracking is off; define CCUT_TRACK_ALLOCS where TEST_MAIN() is used";
+    else if (max == 0)
+        os << "Expected NO ALLOCATIONS, but got " << count << " (" << bytes << " bytes)";
+    else
+        os << "Expected at most [" << max_str << "] ALLOCATIONS, but got " << count << " (" << bytes << " bytes)";
+    os << ": \"" << str << '"';
+    report_failure(os.str(), line, fatal);
+}
+
+// Counts the calling thread's allocations over its lifetime. Other threads
+// the measured code hands work to are not counted.
+class alloc_scope
+{
+public:
+    inline alloc_scope()
+        : start_count(thread_allocs().count)
+        , start_bytes(thread_allocs().bytes)
+    {}
+
+    inline uint64_t count() const
+    {
+        return thread_allocs().count - start_count;
+    }
+
+    inline uint64_t bytes() const
+    {
+        return thread_allocs().bytes - start_bytes;
+    }
+
+private:
+    uint64_t start_count;
+    uint64_t start_bytes;
+};
+
+static inline bool assert_max_allocs(const alloc_scope& scope, uint64_t max, const char* max_str, const char* str,
+                                     int line, bool fatal = true)
+{
+    if (CCUT_UNLIKELY(!alloc_tracking() || scope.count() > max))
+    {
+        fail_allocs(max, max_str, scope.count(), scope.bytes(), str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+// Run a block of code and check how often it allocated
+#define CCUT_ASSERT_ALLOCS_IMPL(check, max, max_str, fatal, ...)                                                  \
+    do                                                                                                           \
+    {                                                                                                            \
+        ccut_framework::alloc_scope ccut_alloc_scope;                                                            \
+        __VA_ARGS__;                                                                                             \
+        check(ccut_framework::assert_max_allocs(ccut_alloc_scope, max, max_str, #__VA_ARGS__, __LINE__, fatal)); \
+    } while (0)
+
+#if CCUT_HAS_FORK
+CCUT_COLD static inline void fail_child(const char* expected, const child_outcome& outcome, bool mismatched,
+                                        const char* str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    os << "Expected " << expected << ", but ";
+    switch (outcome.end)
+    {
+    case child_outcome::returned:
+        os << "the statement returned";
+        break;
+    case child_outcome::threw:
+        os << "the statement threw \"" << outcome.detail << '"';
+        break;
+    case child_outcome::exited:
+        os << "the child exited with code " << outcome.code;
+        break;
+    case child_outcome::signaled:
+        os << "the child was killed by signal " << outcome.code;
+        if (const char* name = ::strsignal(outcome.code))
+            os << " (" << name << ")";
+        break;
+    case child_outcome::unstarted:
+        os << "the child could not be started (" << outcome.detail << ')';
+        break;
+    case child_outcome::timed_out:
+        os << "the child was still running after " << outcome.detail << " and was killed";
+        break;
+    }
+    if (mismatched)
+        os << " and its stderr did not match";
+    os << ": \"" << str << '"';
+    // Drop the trailing newline most diagnostics end with
+    size_t shown = outcome.output.size();
+    while (shown > 0 && outcome.output[shown - 1] == '\n')
+        --shown;
+    if (shown > 0)
+    {
+        os << "; stderr: ";
+        format_string(os, outcome.output.data(), shown);
+    }
+    report_failure(os.str(), line, fatal);
+}
+
+CCUT_COLD static inline void fail_pattern(const char* pattern, const char* error, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    report_failure(std::string("Invalid death test pattern \"") + pattern + "\": " + error, line, fatal);
+}
+
+// Passes if the statement ended its process by a signal, as abort() and
+// failed assert()s do, or by exiting with a nonzero code, and what it wrote
+// to stderr matches a POSIX extended regular expression
+static inline bool assert_death(const child_outcome& outcome, const char* pattern, const char* str, int line,
+                                bool fatal = true)
+{
+    bool died = outcome.end == child_outcome::signaled || (outcome.end == child_outcome::exited && outcome.code);
+
+    regex_t regex;
+    int error = ::regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB);
+    if (CCUT_UNLIKELY(error))
+    {
+        char message[256];
+        ::regerror(error, &regex, message, sizeof(message));
+        fail_pattern(pattern, message, line, fatal);
+        return false;
+    }
+    bool matched = ::regexec(&regex, outcome.output.c_str(), 0, nullptr, 0) == 0;
+    ::regfree(&regex);
+
+    if (CCUT_UNLIKELY(!died || !matched))
+    {
+        std::string expected = std::string("DEATH with stderr matching \"") + pattern + '"';
+        fail_child(expected.c_str(), outcome, died && !matched, str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+// Passes if the statement ended its process by exiting with the given code
+static inline bool assert_exit(const child_outcome& outcome, int code, const char* str, int line, bool fatal = true)
+{
+    if (CCUT_UNLIKELY(outcome.end != child_outcome::exited || outcome.code != code))
+    {
+        std::string expected = "EXIT with code " + std::to_string(code);
+        fail_child(expected.c_str(), outcome, false, str, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+// Run a statement in a forked child, for the death checks
+#define CCUT_IN_CHILD(statement) ccut_framework::run_statement_in_child([&]() { statement; })
+#endif
+
+// Report data that doesn't match its golden file, or a golden file that
+// couldn't be read, with the errno of the failed read
+CCUT_COLD static inline void fail_golden(const unsigned char* data, size_t size, const unsigned char* golden,
+                                         size_t golden_size, int read_error, const char* path, const char* data_str,
+                                         int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::ostringstream os;
+    if (read_error)
+    {
+        os << "Expected GOLDEN MATCH, but the golden file \"" << path << '"';
+        if (read_error == ENOENT)
+            os << " does not exist";
+        else
+            os << " could not be read (" << std::strerror(read_error) << ')';
+        os << ": [" << data_str << "] (rerun with --update-golden to write it)";
+        report_failure(os.str(), line, fatal);
+        return;
+    }
+
+    size_t common = std::min(size, golden_size);
+    size_t offset = bytes_mismatch(data, golden, common);
+    os << "Expected GOLDEN MATCH, but was NOT GOLDEN MATCH: [" << data_str << "] and \"" << path << "\" (";
+    if (size != golden_size)
+        os << "sizes differ: " << size << " vs " << golden_size << " bytes; ";
+    if (offset == common)
+    {
+        os << "equal up to offset " << offset;
+    }
+    else
+    {
+        size_t first = offset > byte_context ? offset - byte_context : 0;
+        os << "first difference at offset " << offset << " (0x" << std::hex << offset << std::dec << ')';
+        if (size == golden_size)
+            os << " of " << size << " bytes";
+        os << "; bytes from " << first << ": ";
+        write_byte_window(os, data, first, std::min(size, offset + byte_context), offset);
+        os << " vs ";
+        write_byte_window(os, golden, first, std::min(golden_size, offset + byte_context), offset);
+    }
+    os << "; rerun with --update-golden to accept the data)";
+    report_failure(os.str(), line, fatal);
+}
+
+CCUT_COLD static inline void fail_golden_update(const char* path, int write_error, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    report_failure(std::string("Could not update golden file \"") + path + "\": " + std::strerror(write_error), line,
+                   fatal);
+}
+
+// Passes if data matches a golden file byte for byte. The file is mapped
+// rather than read, so a huge golden file costs no copy. Under
+// --update-golden a file that doesn't match or doesn't exist is replaced
+// with the data instead, in one step, so tests may share golden files.
+static inline bool assert_matches_golden(const void* data, size_t size, const char* path, const char* data_str,
+                                         int line, bool fatal = true)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    {
+        mapped_file golden;
+        if (golden.open(path))
+        {
+            if (CCUT_LIKELY(golden.size() == size && bytes_mismatch(bytes, golden.data(), size) == size))
+                return true;
+            if (!golden_update())
+            {
+                fail_golden(bytes, size, golden.data(), golden.size(), 0, path, data_str, line, fatal);
+                return false;
+            }
+        }
+        else if (!golden_update() || errno != ENOENT)
+        {
+            fail_golden(bytes, size, nullptr, 0, errno, path, data_str, line, fatal);
+            return false;
+        }
+    }
+
+    if (!replace_file(path, data, size))
+    {
+        fail_golden_update(path, errno, line, fatal);
+        return false;
+    }
+    return true;
+}
+
+// Left operand of a comma that keeps the value of the right operand, when it
+// has one, from being optimized away. A void right operand uses the built-in
+// comma instead.
+struct timed_sink
+{};
+
+template <typename T>
+static inline void operator,(timed_sink, const T& value)
+{
+    do_not_optimize(value);
+}
+
+// Wrap an expression to be timed so its work isn't optimized away
+#define CCUT_TIMED(expr)                            \
+    [&]() {                                         \
+        (void)(ccut_framework::timed_sink(), expr); \
+        ccut_framework::clobber_memory();           \
+    }
+
+//                  //
+// Assertion Macros //
+//                  //
+
+// The budget is a std::chrono duration, as in ASSERT_DURATION_BELOW(sort(v), std::chrono::milliseconds(5))
+#define ASSERT_DURATION_BELOW( expr, budget ) \
+    CCUT_ASSERT(ccut_framework::assert_duration_below(CCUT_TIMED(expr), ccut_framework::duration_ns(budget), #expr, #budget, __LINE__))
+
+// Fails if the block allocates, as in ASSERT_NO_ALLOC({ queue.push(item); }).
+// Needs allocation tracking; see CCUT_TRACK_ALLOCS.
+#define ASSERT_NO_ALLOC( ... ) CCUT_ASSERT_ALLOCS_IMPL(CCUT_ASSERT, 0, "0", true, __VA_ARGS__)
+#define ASSERT_MAX_ALLOCS( max, ... ) CCUT_ASSERT_ALLOCS_IMPL(CCUT_ASSERT, max, #max, true, __VA_ARGS__)
+
+// Passes if a's median time is at most 1/ratio of b's
+#define ASSERT_FASTER_THAN( a, b, ratio ) \
+    CCUT_ASSERT(ccut_framework::assert_faster_than(CCUT_TIMED(a), CCUT_TIMED(b), ratio, #a, #b, #ratio, __LINE__))
+
+// Compare size bytes at data with a golden file, as in
+// ASSERT_MATCHES_GOLDEN(image.data(), image.size(), "golden/render.png").
+// Run with --update-golden to write the files that differ.
+#define ASSERT_MATCHES_GOLDEN( data, size, path ) \
+    CCUT_ASSERT(ccut_framework::assert_matches_golden(data, size, path, #data, __LINE__))
+
+// Run a statement in a child process and check that it dies with stderr
+// matching a POSIX extended regex, as in ASSERT_DEATH(queue.pop(), "empty
+// queue"), or exits with a code, as in ASSERT_EXIT(std::exit(3), 3)
+#if CCUT_HAS_FORK
+#define ASSERT_DEATH( statement, regex ) \
+    CCUT_ASSERT(ccut_framework::assert_death(CCUT_IN_CHILD(statement), regex, #statement, __LINE__))
+#define ASSERT_EXIT( statement, code ) \
+    CCUT_ASSERT(ccut_framework::assert_exit(CCUT_IN_CHILD(statement), code, #statement, __LINE__))
+#else
+#define ASSERT_DEATH( statement, regex ) static_assert(!sizeof(#statement), "death tests need fork()")
+#define ASSERT_EXIT( statement, code ) static_assert(!sizeof(#statement), "death tests need fork()")
+#endif
+
+// EXPECT_* records the failure and lets the test carry on
+#define EXPECT_NO_ALLOC( ... ) CCUT_ASSERT_ALLOCS_IMPL(CCUT_EXPECT, 0, "0", false, __VA_ARGS__)
+#define EXPECT_MAX_ALLOCS( max, ... ) CCUT_ASSERT_ALLOCS_IMPL(CCUT_EXPECT, max, #max, false, __VA_ARGS__)
+#define EXPECT_DURATION_BELOW( expr, budget ) \
+    CCUT_EXPECT(ccut_framework::assert_duration_below(CCUT_TIMED(expr), ccut_framework::duration_ns(budget), #expr, #budget, __LINE__, false))
+#define EXPECT_FASTER_THAN( a, b, ratio ) \
+    CCUT_EXPECT(ccut_framework::assert_faster_than(CCUT_TIMED(a), CCUT_TIMED(b), ratio, #a, #b, #ratio, __LINE__, false))
+#define EXPECT_MATCHES_GOLDEN( data, size, path ) \
+    CCUT_EXPECT(ccut_framework::assert_matches_golden(data, size, path, #data, __LINE__, false))
+#if CCUT_HAS_FORK
+#define EXPECT_DEATH( statement, regex ) \
+    CCUT_EXPECT(ccut_framework::assert_death(CCUT_IN_CHILD(statement), regex, #statement, __LINE__, false))
+#define EXPECT_EXIT( statement, code ) \
+    CCUT_EXPECT(ccut_framework::assert_exit(CCUT_IN_CHILD(statement), code, #statement, __LINE__, false))
+#else
+#define EXPECT_DEATH( statement, regex ) static_assert(!sizeof(#statement), "death tests need fork()")
+#define EXPECT_EXIT( statement, code ) static_assert(!sizeof(#statement), "death tests need fork()")
+#endif
+
+#define CCUT_TEST_F_IMPL(fixture_type, funcname, serial, ...)                                                    \
+    static inline void ccut_##fixture_type##_##funcname(fixture_type&);                     /* declare body */  \
+    static inline void ccut_run_##fixture_type##_##funcname()                               /* wrap body */     \
+    {                                                                                                            \
+        ccut_framework::run_with_fixture<fixture_type>(&ccut_##fixture_type##_##funcname);                       \
+    }                                                                                                            \
+    static const char* const ccut_tags_##fixture_type##_##funcname[] = {__VA_ARGS__};       /* tag list */      \
+    static ccut_framework::RegisterTest register_ccut_##fixture_type##_##funcname(                               \
+        #fixture_type "." #funcname, &ccut_run_##fixture_type##_##funcname, serial,                              \
+        ccut_tags_##fixture_type##_##funcname);                                             /* register test */ \
+    void ccut_##fixture_type##_##funcname([[maybe_unused]] fixture_type& fixture)           /* implement body */
+
+// Expands the split-up TEST_F() arguments before they reach CCUT_TEST_F_IMPL()
+#define CCUT_TEST_F_EXPANDED(...) CCUT_EXPAND(CCUT_TEST_F_IMPL(__VA_ARGS__))
+
+// Declare a test that runs with an instance of a fixture class, reachable in
+// the body as `fixture`, as in TEST_F(database, finds_rows, "io"). The test
+// is named "database.finds_rows". Instances are pooled and reused between
+// tests; see test_fixture.
+#define TEST_F(fixture_type, ...) \
+    CCUT_TEST_F_EXPANDED(fixture_type, CCUT_FIRST(__VA_ARGS__, ~), false, CCUT_REST(__VA_ARGS__, nullptr))
+
+// Declare a fixture test that is never run concurrently with other tests
+#define TEST_F_SERIAL(fixture_type, ...) \
+    CCUT_TEST_F_EXPANDED(fixture_type, CCUT_FIRST(__VA_ARGS__, ~), true, CCUT_REST(__VA_ARGS__, nullptr))
+
+#if CCUT_HAS_COROUTINES
+#define CCUT_TEST_ASYNC_IMPL(funcname, serial, ...)                                                              \
+    static ccut_framework::task<> funcname();                                               /* declare test */  \
+    static void ccut_start_##funcname(ccut_framework::async_test& test)                     /* start body */    \
+    {                                                                                                            \
+        ccut_framework::start_async(funcname(), test);                                                           \
+    }                                                                                                            \
+    static void ccut_run_##funcname()                                                       /* run it alone */  \
+    {                                                                                                            \
+        ccut_framework::run_async_inline(&ccut_start_##funcname);                                                \
+    }                                                                                                            \
+    static const char* const ccut_tags_##funcname[] = {__VA_ARGS__};                        /* tag list */      \
+    static ccut_framework::RegisterTest register_ccut_##funcname(#funcname, &ccut_run_##funcname, serial,        \
+                                                                 ccut_tags_##funcname,                           \
+                                                                 &ccut_start_##funcname);   /* register test */ \
+    ccut_framework::task<> funcname()                                                       /* implement test */
+
+// Expands the split-up TEST_ASYNC() arguments before they reach CCUT_TEST_ASYNC_IMPL()
+#define CCUT_TEST_ASYNC_EXPANDED(...) CCUT_EXPAND(CCUT_TEST_ASYNC_IMPL(__VA_ARGS__))
+
+// Declare a test whose body is a coroutine, as in TEST_ASYNC(echoes, "io").
+// The body can co_await other ccut_framework::task<T> coroutines, any other
+// awaitable that resumes it through ccut_framework::suspend(), and
+// ccut_framework::sleep_for() and yield(). Async tests run together on one
+// thread alongside the rest, overlapping wherever they wait, and a timeout
+// tag counts time spent waiting. Without exceptions, only EXPECT_* can be
+// used in the body, since ASSERT_* would need to co_return.
+#define TEST_ASYNC(...) CCUT_TEST_ASYNC_EXPANDED(CCUT_FIRST(__VA_ARGS__, ~), false, CCUT_REST(__VA_ARGS__, nullptr))
+
+// Declare an async test that is never run concurrently with other tests
+#define TEST_ASYNC_SERIAL(...) \
+    CCUT_TEST_ASYNC_EXPANDED(CCUT_FIRST(__VA_ARGS__, ~), true, CCUT_REST(__VA_ARGS__, nullptr))
+#endif
+
+// Declare a test once for each of a list of types, reachable in the body as
+// TypeParam, as in TYPED_TEST(parses_numbers, int, float, double). The
+// instances are named "parses_numbers<int>" and so on.
+#define TYPED_TEST(name, ...)                                                                                \
+    template <typename TypeParam>                                                                            \
+    struct ccut_typed_##name                                                                                 \
+    {                                                                                                        \
+        static void run();                                                                                   \
+    };                                                                                                       \
+    static ccut_framework::RegisterTypedTest<ccut_typed_##name, __VA_ARGS__> register_ccut_##name(#name,     \
+                                                                                                 #__VA_ARGS__); \
+    template <typename TypeParam>                                                                            \
+    void ccut_typed_##name<TypeParam>::run()
+
+// Declare a test once for each of a list of constant values, reachable in the
+// body as `param`, as in TEST_P(fills_buffer, 64, 4096). The instances are
+// named "fills_buffer/64" and so on.
+#define TEST_P(name, ...)                                                                                    \
+    struct ccut_param_##name                                                                                 \
+    {                                                                                                        \
+        static constexpr auto values = ccut_framework::param_values(__VA_ARGS__);                            \
+        typedef decltype(values)::value_type param_type;                                                     \
+        static void body(const param_type& param);                                                           \
+        template <size_t I>                                                                                  \
+        static void run()                                                                                    \
+        {                                                                                                    \
+            body(values[I]);                                                                                 \
+        }                                                                                                    \
+    };                                                                                                       \
+    static ccut_framework::RegisterParamTest<ccut_param_##name> register_ccut_##name(#name, #__VA_ARGS__);   \
+    void ccut_param_##name::body([[maybe_unused]] const param_type& param)
+
+// Replacement global allocation functions that count each test's heap use.
+// TEST_MAIN() includes them when CCUT_TRACK_ALLOCS is defined; a program
+// with its own main() can use this once, at global scope, instead. Sized and
+// array forms of new default to these.
+#define CCUT_ALLOC_HOOKS()                                                                                   \
+    void* operator new(std::size_t size)                                                                     \
+    {                                                                                                        \
+        return ccut_framework::tracked_new(size);                                                            \
+    }                                                                                                        \
+    void* operator new(std::size_t size, std::align_val_t align)                                             \
+    {                                                                                                        \
+        return ccut_framework::tracked_aligned_new(size, align);                                             \
+    }                                                                                                        \
+    void operator delete(void* ptr) noexcept                                                                 \
+    {                                                                                                        \
+        ccut_framework::tracked_delete(ptr);                                                                 \
+    }                                                                                                        \
+    void operator delete(void* ptr, std::align_val_t) noexcept                                               \
+    {                                                                                                        \
+        ccut_framework::tracked_aligned_delete(ptr);                                                         \
+    }                                                                                                        \
+    void operator delete(void* ptr, std::size_t) noexcept                                                    \
+    {                                                                                                        \
+        ccut_framework::tracked_delete(ptr);                                                                 \
+    }                                                                                                        \
+    void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept                                  \
+    {                                                                                                        \
+        ccut_framework::tracked_aligned_delete(ptr);                                                         \
+    }                                                                                                        \
+    static const bool ccut_alloc_hooks_installed = (ccut_framework::alloc_tracking() = true);
+
+#if defined(CCUT_TRACK_ALLOCS)
+#define CCUT_MAIN_ALLOC_HOOKS() CCUT_ALLOC_HOOKS()
+#else
+#define CCUT_MAIN_ALLOC_HOOKS()
+#endif
+
+// The out-of-line half of the lean assertions in ccut_core.h, formatting
+// their operands the way the checks above would
+#if defined(CCUT_IMPLEMENT)
+namespace lean
+{
+
+static inline std::string describe(const value_ref& value)
+{
+    std::ostringstream os;
+    switch (value.kind)
+    {
+    case value_ref::bytes:
+        format_bytes(os, value.data, value.size);
+        break;
+    case value_ref::boolean:
+        format_value(os, value.unsigned_value != 0);
+        break;
+    case value_ref::character:
+        format_value(os, static_cast<char>(value.signed_value));
+        break;
+    case value_ref::narrow:
+        os << static_cast<char>(value.signed_value);
+        break;
+    case value_ref::signed_int:
+        os << value.signed_value;
+        break;
+    case value_ref::unsigned_int:
+        os << value.unsigned_value;
+        break;
+    case value_ref::floating:
+        if (value.size == sizeof(float))
+            format_value(os, static_cast<float>(value.floating_value));
+        else if (value.size == sizeof(double))
+            format_value(os, static_cast<double>(value.floating_value));
+        else
+            format_value(os, value.floating_value);
+        break;
+    case value_ref::c_string:
+        if (value.data)
+            format_string(os, static_cast<const char*>(value.data), value.size);
+        else
+            os << "nullptr";
+        break;
+    case value_ref::string:
+        format_string(os, static_cast<const char*>(value.data), value.size);
+        break;
+    case value_ref::pointer:
+        os << value.data;
+        break;
+    case value_ref::null_pointer:
+        os << "nullptr";
+        break;
+    }
+    return os.str();
+}
+
+void fail_boolean(bool expected, const char* str, int line, bool fatal)
+{
+    ccut_framework::fail_boolean(expected, str, line, fatal);
+}
+
+void fail_values(const char* kind, const value_ref& lhs, const value_ref& rhs, const char* lhs_str,
+                 const char* rhs_str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::string difference;
+    if (lhs.kind == value_ref::string && rhs.kind == value_ref::string)
+    {
+        difference = describe_difference(std::string(static_cast<const char*>(lhs.data), lhs.size),
+                                         std::string(static_cast<const char*>(rhs.data), rhs.size), format_rank<1>());
+    }
+    fail_comparison(kind, lhs_str, rhs_str, describe(lhs), describe(rhs), difference, line, fatal);
+}
+
+void fail_exception(bool expected, const char* str, int line, bool fatal)
+{
+    ccut_framework::fail_exception(expected, str, line, fatal);
+}
+
+void fail_near(float_measure measure, long double lhs, long double rhs, size_t float_size, long double found,
+               const char* lhs_str, const char* rhs_str, const char* limit_str, int line, bool fatal)
+{
+    ccut_framework::fail_near(measure, lhs, rhs, float_size, found, lhs_str, rhs_str, limit_str, line, fatal);
+}
+
+void fail_array_near(long double lhs, long double rhs, size_t float_size, size_t index, size_t far, size_t count,
+                     const char* lhs_str, const char* rhs_str, const char* limit_str, int line, bool fatal)
+{
+    ccut_framework::fail_array_near(lhs, rhs, float_size, index, far, count, lhs_str, rhs_str, limit_str,
+                                    line, fatal);
+}
+
+void fail_bytes(const void* lhs, const void* rhs, size_t size, size_t offset, const char* lhs_str,
+                const char* rhs_str, int line, bool fatal)
+{
+    ccut_framework::fail_bytes(lhs, rhs, size, offset, lhs_str, rhs_str, line, fatal);
+}
+
+void fail_range(const char* kind, const range_difference& where, const value_ref* lhs, const value_ref* rhs,
+                const char* lhs_str, const char* rhs_str, int line, bool fatal)
+{
+    untracked_allocs untracked;
+    std::string lhs_items[2 * range_context + 1];
+    std::string rhs_items[2 * range_context + 1];
+    for (size_t i = 0; i < where.lhs_shown; i++)
+    {
+        lhs_items[i] = describe(lhs[i]);
+    }
+    for (size_t i = 0; i < where.rhs_shown; i++)
+    {
+        rhs_items[i] = describe(rhs[i]);
+    }
+    ccut_framework::fail_range(kind, where, lhs_items, rhs_items, lhs_str, rhs_str, line, fatal);
+}
 
-// Declare a new test function
-#define TEST(funcname)                                                                                      \
-    static inline void funcname();                                                      /* declare test */  \
-    static ccut_framework::RegisterTest register_ccut_##funcname(#funcname, &funcname); /* register test */ \
-    void funcname()                                                                     /* implement test */
+} // namespace lean
+#endif
 
 // Run main test script
-#define TEST_MAIN() int main() { return ccut_framework::test_main(); }
+#define TEST_MAIN() \
+    CCUT_MAIN_ALLOC_HOOKS() \
+    int main(int argc, char** argv) { return ccut_framework::test_main(argc, argv); }
 
 } // namespace ccut_framework
 